@@ -0,0 +1,172 @@
+#ifndef ACCUMULATOR_H
+#define ACCUMULATOR_H
+
+#include <SDL.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "escapekernel.h"
+#include "framebuffer.h"
+#include "palette.h"
+#include "supersample.h"
+#include "threadpool.h"
+#include "viewport.h"
+
+// Samples and iterations an Accumulator added in one call.
+struct AccumulateStats {
+    long long samples = 0;
+    long long iterations = 0;
+};
+
+// Anti-aliasing of a frame that stays on screen, a few rows at a time, for
+// idle time: every pass adds one more sample to every pixel, and the pixel
+// shows the mean color of all of them, kept as float sums so that hundreds
+// of samples add up without rounding. The frame's own colors are the first
+// sample.
+//
+// The n-th pass puts its samples at the n-th point of the R2 sequence, which
+// covers the pixel evenly however many passes there are, shifted by a hashed
+// offset for every row so that neighbouring rows do not move in step. Samples
+// of a row share their offset, so a row is one EscapeRow across the frame.
+//
+// A pass that changes the shown color of fewer than STABLE of the pixels,
+// after at least MIN_SAMPLES, or the MAX_SAMPLES-th pass, ends the
+// accumulation: converged() is then true until reset().
+class Accumulator {
+public:
+    static const int MIN_SAMPLES = 16;
+    static const int MAX_SAMPLES = 64;
+
+    Accumulator(ThreadPool& pool, EscapeSpanFn span, int width, int height)
+        : pool(pool), span(span), width(width), height(height), sums(3 * width * height), changed(height) {
+    }
+
+    // The kernel for the samples, normally the one the frame was computed
+    // with so they agree with its first samples.
+    void setKernel(EscapeSpanFn kernel) {
+        span = kernel;
+    }
+
+    void setSeed(double re, double im) {
+        seedRe = re;
+        seedIm = im;
+    }
+
+    // Drops the samples, for a frame that changed.
+    void reset() {
+        samples = 0;
+        done = false;
+    }
+
+    bool converged() const {
+        return done;
+    }
+
+    // Samples every pixel has from the finished passes, its first included.
+    int samplesPerPixel() const {
+        return samples;
+    }
+
+    // Adds the samples of the next rows of the current pass, at most count
+    // of them, to the frame in out (pitch pixels between rows), which holds
+    // the frame's colors after a reset() and the means since. The palette
+    // must be set up for maxIter.
+    AccumulateStats accumulate(const Viewport& view, int maxIter, const Palette& palette, ColorMode mode, int count,
+                               Uint32* out, int pitch) {
+        AccumulateStats stats;
+        if (done) {
+            return stats;
+        }
+        if (samples == 0) {
+            begin(out, pitch);
+        }
+        int end = std::min(height, nextRow + count);
+        std::vector<AccumulateStats> slotStats(pool.size() + 1);
+        pool.parallelFor(end - nextRow, [&](int i, int slot) {
+            int y = nextRow + i;
+            changed[y] = sampleRow(view, maxIter, palette, mode, y, &out[y * pitch], slotStats[slot]);
+        });
+        for (const AccumulateStats& slot : slotStats) {
+            stats.samples += slot.samples;
+            stats.iterations += slot.iterations;
+        }
+        nextRow = end;
+        if (nextRow == height) {
+            long long moved = 0;
+            for (int y = 0; y < height; ++y) {
+                moved += changed[y];
+            }
+            samples++;
+            nextRow = 0;
+            done = samples >= MAX_SAMPLES || (samples >= MIN_SAMPLES && moved < STABLE * width * height);
+        }
+        return stats;
+    }
+
+private:
+    static constexpr double STABLE = 0.001;
+
+    // Takes the frame's colors as the first sample.
+    void begin(const Uint32* out, int pitch) {
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                Uint32 color = out[y * pitch + x];
+                float* sum = &sums[3 * (y * width + x)];
+                for (int c = 0; c < 3; ++c) {
+                    sum[c] = (float)((color >> (16 - 8 * c)) & 0xFF);
+                }
+            }
+        }
+        samples = 1;
+        nextRow = 0;
+    }
+
+    // Adds a sample of the current pass to every pixel of row y, writes
+    // their means to out and returns how many of them changed.
+    int sampleRow(const Viewport& view, int maxIter, const Palette& palette, ColorMode mode, int y, Uint32* out,
+                  AccumulateStats& stats) {
+        const double G = 1.32471795724474602596; // x^3 = x + 1
+        std::vector<int> iters(width);
+        std::vector<float> smooth(width);
+        std::vector<Uint32> colors(width);
+        float* smoothOut = mode == COLOR_BANDED ? nullptr : smooth.data();
+        double dx = std::fmod(samples / G + jitter(y, 0), 1.0) - 0.5;
+        double dy = std::fmod(samples / (G * G) + jitter(y, 1), 1.0) - 0.5;
+        EscapeRow row = { view.re0 + dx * view.dre, view.dre, view.im0 + (y + dy) * view.dim, 0, 1, width, maxIter,
+                          true, iters.data(), smoothOut, nullptr, seedRe, seedIm };
+        EscapeStats escape;
+        span(row, escape);
+        palette.colorRow(mode, iters.data(), smoothOut, colors.data(), width);
+        float weight = 1.0f / (samples + 1);
+        int moved = 0;
+        float* sum = &sums[3 * y * width];
+        for (int x = 0; x < width; ++x, sum += 3) {
+            int mean[3];
+            for (int c = 0; c < 3; ++c) {
+                sum[c] += (float)((colors[x] >> (16 - 8 * c)) & 0xFF);
+                mean[c] = std::min((int)(sum[c] * weight + 0.5f), 255);
+            }
+            Uint32 color = packColor(mean[0], mean[1], mean[2]);
+            moved += color != out[x];
+            out[x] = color;
+        }
+        stats.samples += width;
+        stats.iterations += escape.iterations;
+        return moved;
+    }
+
+    ThreadPool& pool;
+    EscapeSpanFn span;
+    int width;
+    int height;
+    double seedRe = 0.0;
+    double seedIm = 0.0;
+    std::vector<float> sums;
+    std::vector<int> changed;
+    int samples = 0;
+    int nextRow = 0;
+    bool done = false;
+};
+
+#endif
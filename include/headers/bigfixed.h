@@ -0,0 +1,234 @@
+#ifndef BIGFIXED_H
+#define BIGFIXED_H
+
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Signed fixed-point number for coordinates beyond double precision. The
+// magnitude is stored as little-endian 32-bit limbs; the top limb is the
+// integer part and the others are the fraction, so a number with n limbs
+// resolves 2^(-32 * (n - 1)). All operands of an operation must have the same
+// number of limbs. Products are truncated, not rounded.
+class BigFixed {
+public:
+    explicit BigFixed(int limbs = 3) : negative(false), mag(limbs, 0) {
+    }
+
+    // Enough limbs to resolve the given pixel size, with 64 bits to spare.
+    static int limbsFor(double pixelSize) {
+        int bits = (int)std::ceil(-std::log2(pixelSize)) + 64;
+        return (bits > 0 ? (bits + 31) / 32 : 0) + 1;
+    }
+
+    static BigFixed fromDouble(double value, int limbs) {
+        BigFixed result(limbs);
+        result.negative = value < 0;
+        double rest = std::fabs(value);
+        for (int i = limbs - 1; i >= 0 && rest > 0; --i) {
+            double limb = std::floor(rest);
+            result.mag[i] = (uint32_t)limb;
+            rest = (rest - limb) * 4294967296.0;
+        }
+        return result;
+    }
+
+    // Parses a plain decimal such as "-0.7436438870371587047521915". Returns
+    // false if text is not one.
+    static bool parse(const std::string& text, int limbs, BigFixed& out) {
+        out = BigFixed(limbs);
+        size_t i = 0;
+        bool negative = false;
+        if (i < text.size() && (text[i] == '-' || text[i] == '+')) {
+            negative = text[i] == '-';
+            i++;
+        }
+        size_t point = text.find('.', i);
+        std::string whole = text.substr(i, point == std::string::npos ? std::string::npos : point - i);
+        std::string fraction = point == std::string::npos ? "" : text.substr(point + 1);
+        if (whole.empty() && fraction.empty()) {
+            return false;
+        }
+
+        // Fraction digits from the last one up: f = (f + digit) / 10.
+        for (size_t k = fraction.size(); k-- > 0;) {
+            if (fraction[k] < '0' || fraction[k] > '9') {
+                return false;
+            }
+            out.mag[limbs - 1] = fraction[k] - '0';
+            out.divideSmall(10);
+        }
+        uint64_t integer = 0;
+        for (char digit : whole) {
+            if (digit < '0' || digit > '9') {
+                return false;
+            }
+            integer = integer * 10 + (digit - '0');
+            if (integer > 0xFFFFFFFFu) {
+                return false;
+            }
+        }
+        out.mag[limbs - 1] = (uint32_t)integer;
+        out.negative = negative && !out.isZero();
+        return true;
+    }
+
+    int limbs() const {
+        return (int)mag.size();
+    }
+
+    // Limb i of the magnitude, the integer part at limbs() - 1.
+    uint32_t limb(int i) const {
+        return mag[i];
+    }
+
+    bool isNegative() const {
+        return negative;
+    }
+
+    // The same value with more (or fewer, truncating) fraction limbs.
+    BigFixed withLimbs(int count) const {
+        BigFixed result(count);
+        for (int i = 0; i < count && i < limbs(); ++i) {
+            result.mag[count - 1 - i] = mag[limbs() - 1 - i];
+        }
+        result.negative = negative && !result.isZero();
+        return result;
+    }
+
+    double toDouble() const {
+        double result = 0.0;
+        double scale = 1.0;
+        for (int i = limbs() - 1; i >= 0; --i) {
+            result += mag[i] * scale;
+            scale /= 4294967296.0;
+        }
+        return negative ? -result : result;
+    }
+
+    std::string toString(int digits) const {
+        std::string text = negative ? "-" : "";
+        text += std::to_string(mag[limbs() - 1]);
+        text += '.';
+        BigFixed fraction = *this;
+        for (int i = 0; i < digits; ++i) {
+            fraction.mag[limbs() - 1] = 0;
+            fraction.multiplySmall(10);
+            text += (char)('0' + fraction.mag[limbs() - 1]);
+        }
+        return text;
+    }
+
+    bool isZero() const {
+        for (uint32_t limb : mag) {
+            if (limb != 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    BigFixed operator-() const {
+        BigFixed result = *this;
+        result.negative = !negative && !isZero();
+        return result;
+    }
+
+    BigFixed operator+(const BigFixed& other) const {
+        if (negative == other.negative) {
+            BigFixed result = *this;
+            addMagnitude(result.mag, other.mag);
+            return result;
+        }
+        if (compareMagnitude(mag, other.mag) >= 0) {
+            BigFixed result = *this;
+            subtractMagnitude(result.mag, other.mag);
+            result.negative = negative && !result.isZero();
+            return result;
+        }
+        BigFixed result = other;
+        subtractMagnitude(result.mag, mag);
+        return result;
+    }
+
+    BigFixed operator-(const BigFixed& other) const {
+        return *this + (-other);
+    }
+
+    BigFixed operator*(const BigFixed& other) const {
+        int n = limbs();
+        std::vector<uint32_t> product(2 * n, 0);
+        for (int i = 0; i < n; ++i) {
+            uint64_t carry = 0;
+            for (int j = 0; j < n; ++j) {
+                uint64_t t = (uint64_t)mag[i] * other.mag[j] + product[i + j] + carry;
+                product[i + j] = (uint32_t)t;
+                carry = t >> 32;
+            }
+            product[i + n] = (uint32_t)carry;
+        }
+        BigFixed result(n);
+        for (int i = 0; i < n; ++i) {
+            result.mag[i] = product[i + n - 1];
+        }
+        result.negative = (negative != other.negative) && !result.isZero();
+        return result;
+    }
+
+private:
+    static int compareMagnitude(const std::vector<uint32_t>& a, const std::vector<uint32_t>& b) {
+        for (size_t i = a.size(); i-- > 0;) {
+            if (a[i] != b[i]) {
+                return a[i] < b[i] ? -1 : 1;
+            }
+        }
+        return 0;
+    }
+
+    static void addMagnitude(std::vector<uint32_t>& a, const std::vector<uint32_t>& b) {
+        uint64_t carry = 0;
+        for (size_t i = 0; i < a.size(); ++i) {
+            uint64_t t = (uint64_t)a[i] + b[i] + carry;
+            a[i] = (uint32_t)t;
+            carry = t >> 32;
+        }
+    }
+
+    // Requires |a| >= |b|.
+    static void subtractMagnitude(std::vector<uint32_t>& a, const std::vector<uint32_t>& b) {
+        int64_t borrow = 0;
+        for (size_t i = 0; i < a.size(); ++i) {
+            int64_t t = (int64_t)a[i] - b[i] - borrow;
+            borrow = t < 0;
+            a[i] = (uint32_t)(t + (borrow << 32));
+        }
+    }
+
+    void divideSmall(uint32_t divisor) {
+        uint64_t remainder = 0;
+        for (size_t i = mag.size(); i-- > 0;) {
+            uint64_t t = (remainder << 32) | mag[i];
+            mag[i] = (uint32_t)(t / divisor);
+            remainder = t % divisor;
+        }
+    }
+
+    void multiplySmall(uint32_t factor) {
+        uint64_t carry = 0;
+        for (size_t i = 0; i < mag.size(); ++i) {
+            uint64_t t = (uint64_t)mag[i] * factor + carry;
+            mag[i] = (uint32_t)t;
+            carry = t >> 32;
+        }
+    }
+
+    bool negative;
+    std::vector<uint32_t> mag;
+};
+
+inline BigFixed square(const BigFixed& value) {
+    return value * value;
+}
+
+#endif
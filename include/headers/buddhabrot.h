@@ -0,0 +1,275 @@
+#ifndef BUDDHABROT_H
+#define BUDDHABROT_H
+
+#include <SDL.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "escapekernel.h"
+#include "framebuffer.h"
+#include "threadpool.h"
+#include "tilerenderer.h"
+#include "viewport.h"
+
+// Samples taken, orbits drawn, points of them that landed in the image, and
+// iterations of the kernels and of redrawn orbits.
+struct BuddhabrotStats {
+    long long samples = 0;
+    long long orbits = 0;
+    long long points = 0;
+    long long iterations = 0;
+
+    void add(const BuddhabrotStats& other) {
+        samples += other.samples;
+        orbits += other.orbits;
+        points += other.points;
+        iterations += other.iterations;
+    }
+};
+
+// Density of Mandelbrot orbits over a width x height view: the Buddhabrot
+// counts how often the orbits of escaping c pass through each pixel, the
+// anti-Buddhabrot the orbits of c that do not escape within maxIter.
+//
+// c is sampled in rows of ROW_SAMPLES evenly spaced points, from a random
+// offset and at a random height, which the escape-time kernels take as they
+// are; their shortcuts answer c in the main cardioid and period-2 bulb, and
+// on cycles, without iterating to maxIter. A row spans a whole run of
+// neighbouring mask cells that are sampled, picked with a chance that grows
+// with its length so every part of them is sampled alike. Samples spread
+// over a run, unlike ones packed into a cell, have orbits different enough
+// not to draw the same streak many times over. Orbits that count are walked
+// again and every z is added to the density. The set is symmetric about
+// the real axis, so only c with im >= 0 are sampled and every orbit is
+// added together with its mirror image.
+//
+// The mask leaves out cells that cannot contribute. The set has no holes,
+// so a cell whose whole border is inside it lies inside it and no orbit
+// from it escapes; for the anti-Buddhabrot, a cell whose whole border
+// escapes holds no point of the set. Borders are checked at MASK_STEPS
+// points per side, which, as for subdivision, can miss detail thinner than
+// that.
+//
+// Every thread adds into its own histogram, with no atomics; they are summed
+// into the density at the end of accumulate(). Samples come from a random
+// generator seeded per chunk, so a seed gives the same image on any number
+// of threads.
+class Buddhabrot {
+public:
+    static const int ROW_SAMPLES = 16;
+    static const int MASK_CELLS = 256;
+    static const int MASK_STEPS = 4;
+
+    Buddhabrot(ThreadPool& pool, EscapeSpanFn span, const Viewport& view, int width, int height, int maxIter,
+               bool anti)
+        : pool(pool), span(span), view(view), width(width), height(height), maxIter(maxIter), anti(anti),
+          density(width * height, 0) {
+        buildMask();
+    }
+
+    // Takes about samples more samples of c and adds their orbits.
+    BuddhabrotStats accumulate(long long samples, Uint64 seed) {
+        const int ROWS_PER_CHUNK = 4096;
+        long long rows = (samples + ROW_SAMPLES - 1) / ROW_SAMPLES;
+        int chunks = (int)((rows + ROWS_PER_CHUNK - 1) / ROWS_PER_CHUNK);
+        if (histograms.size() != (size_t)pool.size() + 1) {
+            histograms.assign(pool.size() + 1, std::vector<Uint32>());
+        }
+        std::vector<BuddhabrotStats> slotStats(pool.size() + 1);
+        pool.parallelFor(chunks, [&](int chunk, int slot) {
+            std::vector<Uint32>& histogram = histograms[slot];
+            if (histogram.empty()) {
+                histogram.assign(width * height, 0);
+            }
+            Uint64 state = mix(mix(seed) + 0xD1B54A32D192ED03ULL * (Uint64)(chunk + 1));
+            long long first = (long long)chunk * ROWS_PER_CHUNK;
+            int count = (int)std::min<long long>(ROWS_PER_CHUNK, rows - first);
+            for (int i = 0; i < count; ++i) {
+                sampleRow(state, histogram.data(), slotStats[slot]);
+            }
+        });
+
+        // Adds every histogram into the density, by bands of rows.
+        const int ROWS_PER_BAND = 16;
+        pool.parallelFor((height + ROWS_PER_BAND - 1) / ROWS_PER_BAND, [&](int band, int) {
+            int begin = band * ROWS_PER_BAND * width;
+            int end = std::min(height, (band + 1) * ROWS_PER_BAND) * width;
+            for (std::vector<Uint32>& histogram : histograms) {
+                if (histogram.empty()) {
+                    continue;
+                }
+                for (int i = begin; i < end; ++i) {
+                    density[i] += histogram[i];
+                    histogram[i] = 0;
+                }
+            }
+        });
+
+        BuddhabrotStats stats;
+        for (const BuddhabrotStats& slot : slotStats) {
+            stats.add(slot);
+        }
+        return stats;
+    }
+
+    // Share of the sampled region the mask leaves out.
+    double skipped() const {
+        return 1.0 - (runEnds.empty() ? 0.0 : (double)runEnds.back() / (MASK_CELLS * MASK_CELLS));
+    }
+
+    // Gray levels growing with the square root of the density, black up to
+    // the density half the pixels reach, which the orbits that escape at
+    // once spread evenly, and white from the density that only one pixel in
+    // 10000 exceeds.
+    void toImage(Uint32* out, int pitch) const {
+        std::vector<Uint64> sorted(density);
+        size_t rank = sorted.size() - 1 - sorted.size() / 10000;
+        std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+        double white = (double)sorted[rank];
+        std::nth_element(sorted.begin(), sorted.begin() + sorted.size() / 2, sorted.begin() + rank);
+        double black = (double)sorted[sorted.size() / 2];
+        double scale = 1.0 / std::max(white - black, 1.0);
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                double level = std::min(1.0, std::max(0.0, (density[y * width + x] - black) * scale));
+                int gray = (int)(255.0 * std::sqrt(level));
+                out[y * pitch + x] = packColor(gray, gray, gray);
+            }
+        }
+    }
+
+private:
+    // Neighbouring sampled cells of a mask row, from (re0, im).
+    struct Run {
+        double re0;
+        double im;
+        double width;
+    };
+
+    // Region sampled for c, the upper half of the box around |c| <= 2; orbits
+    // from further out leave it at once.
+    static constexpr double SAMPLE_RE0 = -2.0;
+    static constexpr double SAMPLE_RE1 = 2.0;
+    static constexpr double SAMPLE_IM1 = 2.0;
+
+    // The splitmix64 finalizer. Chunks start from their number and the seed
+    // mixed through it, so their streams start far apart: streams that only
+    // differ by a multiple of the step would repeat each other's draws.
+    static Uint64 mix(Uint64 z) {
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    static Uint64 nextRandom(Uint64& state) {
+        state += 0x9E3779B97F4A7C15ULL;
+        return mix(state);
+    }
+
+    static double uniform(Uint64& state) {
+        return (nextRandom(state) >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    // Counts the grid points on the borders of the mask cells and keeps the
+    // runs of cells that can contribute.
+    void buildMask() {
+        int points = MASK_CELLS * MASK_STEPS + 1;
+        double cellWidth = (SAMPLE_RE1 - SAMPLE_RE0) / MASK_CELLS;
+        cellHeight = SAMPLE_IM1 / MASK_CELLS;
+        TileRenderer grid(pool, span, points, points, 1);
+        grid.start(Viewport{ SAMPLE_RE0, 0.0, cellWidth / MASK_STEPS, cellHeight / MASK_STEPS }, maxIter);
+        grid.wait();
+        const std::vector<int>& iters = grid.iterations();
+        for (int cy = 0; cy < MASK_CELLS; ++cy) {
+            bool previous = false;
+            for (int cx = 0; cx < MASK_CELLS; ++cx) {
+                bool allInside = true, allOutside = true;
+                for (int k = 0; k < MASK_STEPS; ++k) {
+                    int x = cx * MASK_STEPS, y = cy * MASK_STEPS;
+                    int border[4] = { iters[y * points + x + k], iters[(y + MASK_STEPS) * points + x + MASK_STEPS - k],
+                                      iters[(y + MASK_STEPS - k) * points + x], iters[(y + k) * points + x + MASK_STEPS] };
+                    for (int iter : border) {
+                        allInside &= iter == maxIter;
+                        allOutside &= iter < maxIter;
+                    }
+                }
+                bool sampled = !(anti ? allOutside : allInside);
+                if (sampled && !previous) {
+                    runs.push_back({ SAMPLE_RE0 + cx * cellWidth, cy * cellHeight, 0.0 });
+                    runEnds.push_back(runEnds.empty() ? 0 : runEnds.back());
+                }
+                if (sampled) {
+                    runs.back().width += cellWidth;
+                    runEnds.back()++;
+                }
+                previous = sampled;
+            }
+        }
+    }
+
+    // One row of samples across a random run; adds the orbits that count.
+    void sampleRow(Uint64& state, Uint32* histogram, BuddhabrotStats& stats) const {
+        if (runs.empty()) {
+            return;
+        }
+        int cell = (int)(nextRandom(state) % runEnds.back());
+        const Run& run = runs[std::upper_bound(runEnds.begin(), runEnds.end(), cell) - runEnds.begin()];
+        double dre = run.width / ROW_SAMPLES;
+        int iters[ROW_SAMPLES];
+        EscapeRow row = { run.re0 + uniform(state) * dre, dre, run.im + uniform(state) * cellHeight, 0, 1, ROW_SAMPLES,
+                          maxIter, true, iters, nullptr, nullptr, 0.0, 0.0 };
+        EscapeStats escape;
+        span(row, escape);
+        stats.samples += ROW_SAMPLES;
+        stats.iterations += escape.iterations;
+        for (int k = 0; k < ROW_SAMPLES; ++k) {
+            if ((iters[k] == maxIter) == anti) {
+                addOrbit(row.re0 + k * dre, row.im, iters[k], histogram, stats);
+            }
+        }
+    }
+
+    // Walks the orbit of c for iterations steps and adds every z, and its
+    // mirror image, that lands in the view.
+    void addOrbit(double cr, double ci, int iterations, Uint32* histogram, BuddhabrotStats& stats) const {
+        double scaleX = 1.0 / view.dre, scaleY = 1.0 / view.dim;
+        double zr = 0.0, zi = 0.0;
+        for (int n = 0; n < iterations; ++n) {
+            double zr2 = zr * zr, zi2 = zi * zi;
+            zi = 2.0 * zr * zi + ci;
+            zr = zr2 - zi2 + cr;
+            double x = (zr - view.re0) * scaleX;
+            if (x < 0.0 || x >= width) {
+                continue;
+            }
+            double y = (zi - view.im0) * scaleY;
+            double mirrored = (-zi - view.im0) * scaleY;
+            if (y >= 0.0 && y < height) {
+                histogram[(int)y * width + (int)x]++;
+                stats.points++;
+            }
+            if (mirrored >= 0.0 && mirrored < height) {
+                histogram[(int)mirrored * width + (int)x]++;
+                stats.points++;
+            }
+        }
+        stats.orbits++;
+        stats.iterations += iterations;
+    }
+
+    ThreadPool& pool;
+    EscapeSpanFn span;
+    Viewport view;
+    int width;
+    int height;
+    int maxIter;
+    bool anti;
+    std::vector<Uint64> density;
+    std::vector<std::vector<Uint32>> histograms;
+    std::vector<Run> runs;
+    std::vector<int> runEnds;
+    double cellHeight = 0.0;
+};
+
+#endif
@@ -0,0 +1,346 @@
+#ifndef ESCAPEKERNEL_H
+#define ESCAPEKERNEL_H
+
+#include <SDL.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "formula.h"
+#include "precision.h"
+
+// Where a pixel's orbit stopped: a running orbit holds z after iter
+// iterations. Escaped and bounded orbits are finished, bounded ones being
+// known never to escape (interior tests and cycles). A value-initialized
+// orbit, or any with iter = 0, starts from the beginning.
+enum OrbitState { ORBIT_RUNNING, ORBIT_ESCAPED, ORBIT_BOUNDED };
+
+struct EscapeOrbit {
+    double zr = 0.0;
+    double zi = 0.0;
+    int iter = 0;
+    OrbitState state = ORBIT_RUNNING;
+};
+
+// One row of pixels for an escape-time kernel: c = (re0 + x * dre, im) for
+// x = x0, x0 + step, ... (count pixels). The iteration count of the k-th
+// pixel goes to iters[k]. Taking pixel indices rather than a shifted re0
+// keeps c identical however the row is split up or strided. For Julia maps
+// that point is z0 instead, and c is (seedRe, seedIm).
+//
+// With shortcuts on, pixels in the main cardioid or the period-2 bulb are
+// answered without iterating (for z^2 + c only), and an orbit that lands
+// exactly on a value it had before (Brent's cycle detection) is known to
+// repeat forever. Both only report maxIter for pixels that would have
+// reached it, so the counts match the brute-force path.
+//
+// If smooth is set, smooth[k] also gets the fractional iteration count of the
+// k-th pixel (see smoothIterations), or maxIter if it did not escape.
+//
+// If orbits is set, it holds one orbit per column, and the pixel in column x
+// carries on from orbits[x] and leaves where it stopped there. Raising
+// maxIter then only continues the pixels that were still running. Pixels
+// whose orbit has already escaped are skipped, leaving their iters and
+// smooth entries as they were.
+struct EscapeRow {
+    double re0;
+    double dre;
+    double im;
+    int x0;
+    int step;
+    int count;
+    int maxIter;
+    bool shortcuts;
+    int* iters;
+    float* smooth;
+    EscapeOrbit* orbits;
+    double seedRe;
+    double seedIm;
+};
+
+// Orbit of the k-th pixel of a row that has orbits.
+inline EscapeOrbit& orbitAt(const EscapeRow& row, int k) {
+    return row.orbits[row.x0 + k * row.step];
+}
+
+// Iterations performed, the iterations each shortcut saved, and how often
+// perturbed pixels were rebased onto the start of the reference orbit.
+struct EscapeStats {
+    long long iterations = 0;
+    long long cardioidPixels = 0;
+    long long cardioidSaved = 0;
+    long long bulbPixels = 0;
+    long long bulbSaved = 0;
+    long long periodicPixels = 0;
+    long long periodicSaved = 0;
+    long long rebases = 0;
+
+    void add(const EscapeStats& other) {
+        iterations += other.iterations;
+        cardioidPixels += other.cardioidPixels;
+        cardioidSaved += other.cardioidSaved;
+        bulbPixels += other.bulbPixels;
+        bulbSaved += other.bulbSaved;
+        periodicPixels += other.periodicPixels;
+        periodicSaved += other.periodicSaved;
+        rebases += other.rebases;
+    }
+};
+
+typedef void (*EscapeSpanFn)(const EscapeRow& row, EscapeStats& stats);
+
+// Continuous iteration count of a pixel that escaped after iter iterations
+// with |z|^2 = norm: iter + 1 - log(log2 |z|) / log(power), for a map of the
+// given degree. It grows smoothly across the bands of equal iter, by less
+// than one per band.
+inline float smoothIterations(int iter, double norm, int power = 2) {
+    return (float)(iter + 1 - std::log2(0.5 * std::log2(norm)) / std::log2((double)power));
+}
+
+// The scalar code has no fused multiply-add to avoid, so its products need no
+// rounding barrier.
+struct Unrounded {
+    template <typename Real>
+    void operator()(Real&) const {
+    }
+};
+
+// Closed-form tests for the main cardioid and the period-2 bulb. Returns true
+// and accounts for the skipped iterations if c lies in either.
+inline bool skipInterior(double cr, double ci, int maxIter, EscapeStats& stats) {
+    double ci2 = ci * ci;
+    double xr = cr - 0.25;
+    double q = xr * xr + ci2;
+    if (q * (q + xr) < 0.25 * ci2) {
+        stats.cardioidPixels++;
+        stats.cardioidSaved += maxIter;
+        return true;
+    }
+    double br = cr + 1.0;
+    if (br * br + ci2 < 0.0625) {
+        stats.bulbPixels++;
+        stats.bulbSaved += maxIter;
+        return true;
+    }
+    return false;
+}
+
+// Iterates Map in Real, which is float or double. The pixel is formed in
+// double and rounded to Real.
+template <typename Real, typename Map, bool Shortcuts>
+inline void escapeSpanScalarImpl(const EscapeRow& row, EscapeStats& stats) {
+    for (int x = 0; x < row.count; ++x) {
+        EscapeOrbit* orbit = row.orbits ? &orbitAt(row, x) : nullptr;
+        if (orbit && orbit->state == ORBIT_ESCAPED) {
+            continue;
+        }
+        double pixelRe = row.re0 + (row.x0 + x * row.step) * row.dre;
+        Real cr = Map::JULIA ? (Real)row.seedRe : (Real)pixelRe;
+        Real ci = Map::JULIA ? (Real)row.seedIm : (Real)row.im;
+        if ((orbit && orbit->state == ORBIT_BOUNDED) ||
+            (Shortcuts && Map::INTERIOR_TESTS && skipInterior(pixelRe, row.im, row.maxIter, stats))) {
+            row.iters[x] = row.maxIter;
+            if (row.smooth) {
+                row.smooth[x] = (float)row.maxIter;
+            }
+            if (orbit) {
+                orbit->state = ORBIT_BOUNDED;
+            }
+            continue;
+        }
+
+        bool resumed = orbit && orbit->iter > 0;
+        Real zr = resumed ? (Real)orbit->zr : Map::JULIA ? (Real)pixelRe : 0;
+        Real zi = resumed ? (Real)orbit->zi : Map::JULIA ? (Real)row.im : 0;
+        Real savedR = zr, savedI = zi;
+        Real norm = 0;
+        int iter = resumed ? orbit->iter : 0;
+        int start = iter;
+        int saveAt = 1;
+        bool cycled = false;
+        while (iter < row.maxIter) {
+            Real zr2 = zr * zr;
+            Real zi2 = zi * zi;
+            norm = zr2 + zi2;
+            if (norm > 4) {
+                break;
+            }
+            Map::step(zr, zi, zr2, zi2, cr, ci, Unrounded());
+            iter++;
+
+            if (Shortcuts) {
+                if (zr == savedR && zi == savedI) {
+                    cycled = true;
+                    break;
+                }
+                if (iter - start == saveAt) {
+                    savedR = zr;
+                    savedI = zi;
+                    saveAt *= 2;
+                }
+            }
+        }
+
+        stats.iterations += iter - start;
+        if (orbit) {
+            *orbit = { zr, zi, iter, cycled ? ORBIT_BOUNDED : iter < row.maxIter ? ORBIT_ESCAPED : ORBIT_RUNNING };
+        }
+        if (cycled) {
+            stats.periodicPixels++;
+            stats.periodicSaved += row.maxIter - iter;
+            iter = row.maxIter;
+        }
+        row.iters[x] = iter;
+        if (row.smooth) {
+            row.smooth[x] = iter < row.maxIter ? smoothIterations(iter, norm, Map::POWER) : (float)row.maxIter;
+        }
+    }
+}
+
+template <typename Real, typename Map>
+inline void escapeSpanScalarMap(const EscapeRow& row, EscapeStats& stats) {
+    if (row.shortcuts) {
+        escapeSpanScalarImpl<Real, Map, true>(row, stats);
+    } else {
+        escapeSpanScalarImpl<Real, Map, false>(row, stats);
+    }
+}
+
+inline void escapeSpanScalar(const EscapeRow& row, EscapeStats& stats) {
+    escapeSpanScalarMap<double, MandelbrotMap>(row, stats);
+}
+
+inline void escapeSpanScalarFloat(const EscapeRow& row, EscapeStats& stats) {
+    escapeSpanScalarMap<float, MandelbrotMap>(row, stats);
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define ESCAPEKERNEL_SIMD 1
+
+// The lane kernels are written once in escapelanes.inl with GCC vector
+// extensions and compiled once per instruction set and precision, in the
+// f64 and f32 namespaces, as templates over the map. GCC splits up vector
+// operations a function's own target cannot do before inlining, so the body
+// has to be defined under the target pragma rather than merely inlined into
+// a function carrying the target attribute.
+#pragma GCC push_options
+#pragma GCC target("sse2")
+namespace escape_sse2 {
+namespace f64 {
+#define ESCAPE_SCALAR double
+#define ESCAPE_INTEGER long long
+#define ESCAPE_LANES 2
+#include "escapelanes.inl"
+#undef ESCAPE_LANES
+#undef ESCAPE_INTEGER
+#undef ESCAPE_SCALAR
+}
+namespace f32 {
+#define ESCAPE_SCALAR float
+#define ESCAPE_INTEGER int
+#define ESCAPE_LANES 4
+#include "escapelanes.inl"
+#undef ESCAPE_LANES
+#undef ESCAPE_INTEGER
+#undef ESCAPE_SCALAR
+}
+}
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+namespace escape_avx2 {
+namespace f64 {
+#define ESCAPE_SCALAR double
+#define ESCAPE_INTEGER long long
+#define ESCAPE_LANES 4
+#include "escapelanes.inl"
+#undef ESCAPE_LANES
+#undef ESCAPE_INTEGER
+#undef ESCAPE_SCALAR
+}
+namespace f32 {
+#define ESCAPE_SCALAR float
+#define ESCAPE_INTEGER int
+#define ESCAPE_LANES 8
+#include "escapelanes.inl"
+#undef ESCAPE_LANES
+#undef ESCAPE_INTEGER
+#undef ESCAPE_SCALAR
+}
+}
+#pragma GCC pop_options
+
+// AVX-512F brings FMA with it; contracting a * b + c would change the counts.
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+namespace escape_avx512 {
+#define ESCAPE_NO_FMA 1
+namespace f64 {
+#define ESCAPE_SCALAR double
+#define ESCAPE_INTEGER long long
+#define ESCAPE_LANES 8
+#include "escapelanes.inl"
+#undef ESCAPE_LANES
+#undef ESCAPE_INTEGER
+#undef ESCAPE_SCALAR
+}
+namespace f32 {
+#define ESCAPE_SCALAR float
+#define ESCAPE_INTEGER int
+#define ESCAPE_LANES 16
+#include "escapelanes.inl"
+#undef ESCAPE_LANES
+#undef ESCAPE_INTEGER
+#undef ESCAPE_SCALAR
+}
+#undef ESCAPE_NO_FMA
+}
+#pragma GCC pop_options
+#endif
+
+struct EscapeKernel {
+    const char* name;
+    EscapeSpanFn span;
+};
+
+template <typename Map>
+inline std::vector<EscapeKernel> availableEscapeKernelsFor(Precision precision) {
+    bool single = precision == PRECISION_FLOAT;
+    std::vector<EscapeKernel> kernels;
+    kernels.push_back({ "scalar", single ? &escapeSpanScalarMap<float, Map> : &escapeSpanScalarMap<double, Map> });
+#ifdef ESCAPEKERNEL_SIMD
+    if (SDL_HasSSE2()) {
+        kernels.push_back({ "SSE2", single ? &escape_sse2::f32::escapeSpan<Map> : &escape_sse2::f64::escapeSpan<Map> });
+    }
+    if (SDL_HasAVX2()) {
+        kernels.push_back({ "AVX2", single ? &escape_avx2::f32::escapeSpan<Map> : &escape_avx2::f64::escapeSpan<Map> });
+    }
+    if (SDL_HasAVX512F()) {
+        kernels.push_back(
+            { "AVX-512", single ? &escape_avx512::f32::escapeSpan<Map> : &escape_avx512::f64::escapeSpan<Map> });
+    }
+#endif
+    return kernels;
+}
+
+// Every kernel this CPU can run in the given precision and formula, narrowest
+// first. Only PRECISION_FLOAT and PRECISION_DOUBLE have span kernels;
+// anything finer is rendered by perturbation.
+inline std::vector<EscapeKernel> availableEscapeKernels(Precision precision = PRECISION_DOUBLE,
+                                                        Formula formula = FORMULA_MANDELBROT) {
+    switch (formula) {
+        case FORMULA_JULIA: return availableEscapeKernelsFor<JuliaMap>(precision);
+        case FORMULA_MULTIBROT3: return availableEscapeKernelsFor<MultibrotMap<3>>(precision);
+        case FORMULA_MULTIBROT4: return availableEscapeKernelsFor<MultibrotMap<4>>(precision);
+        case FORMULA_BURNING_SHIP: return availableEscapeKernelsFor<BurningShipMap>(precision);
+        default: return availableEscapeKernelsFor<MandelbrotMap>(precision);
+    }
+}
+
+// Picks the widest kernel the CPU supports, falling back to scalar code.
+inline EscapeKernel selectEscapeKernel(Precision precision = PRECISION_DOUBLE, Formula formula = FORMULA_MANDELBROT) {
+    return availableEscapeKernels(precision, formula).back();
+}
+
+#endif
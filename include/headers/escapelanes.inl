@@ -0,0 +1,198 @@
+// Lane kernel body, included by escapekernel.h once per instruction set and
+// precision, with ESCAPE_SCALAR the floating-point type, ESCAPE_INTEGER the
+// integer type of the same size and ESCAPE_LANES the number of them per
+// vector. ESCAPE_NO_FMA keeps products from being fused into a following add,
+// on targets that have FMA.
+
+typedef ESCAPE_SCALAR Scalar;
+typedef ESCAPE_SCALAR Real __attribute__((vector_size(sizeof(ESCAPE_SCALAR) * ESCAPE_LANES)));
+typedef ESCAPE_INTEGER Mask __attribute__((vector_size(sizeof(ESCAPE_INTEGER) * ESCAPE_LANES)));
+
+inline Real rounded(Real v) {
+#ifdef ESCAPE_NO_FMA
+    __asm__("" : "+v"(v));
+#endif
+    return v;
+}
+
+// rounded() as the rounding hook of a map's step.
+struct Rounded {
+    void operator()(Real& v) const {
+        v = rounded(v);
+    }
+};
+
+// Real part of c for the k-th pixel of row, with the product kept out of an
+// FMA so it matches the scalar kernel.
+inline double pixelRe(const EscapeRow& row, int k) {
+    double offset = (row.x0 + k * row.step) * row.dre;
+#ifdef ESCAPE_NO_FMA
+    __asm__("" : "+v"(offset));
+#endif
+    return row.re0 + offset;
+}
+
+inline bool anyLane(const Mask& m) {
+    ESCAPE_INTEGER bits = 0;
+    for (int i = 0; i < ESCAPE_LANES; ++i) {
+        bits |= m[i];
+    }
+    return bits != 0;
+}
+
+// Iterates ESCAPE_LANES pixels in lockstep. A lane drops out of the count as
+// soon as it escapes (or is found to cycle), and the group finishes when
+// every lane has dropped out or hit maxIter. The cycle check shares one save
+// schedule across the lanes, which is fine because they all iterate in step.
+// Lanes that dropped out keep iterating; for smooth counts their |z|^2 is
+// captured at the iteration they escaped. c is formed in double and then
+// rounded to Scalar, so narrower lanes see the nearest c they can hold.
+// c and the starting z come from Map: for Julia maps the pixel is z0.
+// Continued orbits can only share the loop if every lane still running
+// stopped at the same count, which is the usual case after raising the cap;
+// groups where they differ go to the scalar loop.
+template <typename Map, bool Shortcuts, bool Smooth>
+inline void escapeSpanLanes(const EscapeRow& row, EscapeStats& stats) {
+    const int N = ESCAPE_LANES;
+
+    const Scalar four = 4;
+    const Scalar ci = Map::JULIA ? (Scalar)row.seedIm : (Scalar)row.im;
+
+    int x = 0;
+    for (; x + N <= row.count; x += N) {
+        Real pixel;
+        for (int i = 0; i < N; ++i) {
+            pixel[i] = (Scalar)pixelRe(row, x + i);
+        }
+        Real zero = pixel * 0;
+        Real cr = Map::JULIA ? zero + (Scalar)row.seedRe : pixel;
+        Real zr = Map::JULIA ? pixel : zero;
+        Real zi = Map::JULIA ? zero + (Scalar)row.im : zero;
+        Mask active = zero == zero;
+        Mask iter = active & 0;
+        Mask cycled = iter;
+        Mask interior = iter;
+        Mask skipped = iter;
+
+        int start = 0;
+        if (row.orbits) {
+            bool staggered = false;
+            start = -1;
+            for (int i = 0; i < N; ++i) {
+                const EscapeOrbit& orbit = orbitAt(row, x + i);
+                if (orbit.iter > 0) {
+                    zr[i] = (Scalar)orbit.zr;
+                    zi[i] = (Scalar)orbit.zi;
+                }
+                interior[i] = orbit.state == ORBIT_BOUNDED ? -1 : 0;
+                skipped[i] = orbit.state == ORBIT_ESCAPED ? -1 : 0;
+                if (orbit.state == ORBIT_RUNNING) {
+                    staggered |= start >= 0 && orbit.iter != start;
+                    start = orbit.iter;
+                }
+            }
+            if (staggered) {
+                EscapeRow group = row;
+                group.x0 = row.x0 + x * row.step;
+                group.count = N;
+                group.iters = row.iters + x;
+                group.smooth = Smooth ? row.smooth + x : nullptr;
+                escapeSpanScalarImpl<Scalar, Map, Shortcuts>(group, stats);
+                continue;
+            }
+            start = std::max(start, 0);
+            iter += start;
+            active &= ~(interior | skipped);
+        }
+
+        if (Shortcuts && Map::INTERIOR_TESTS) {
+            for (int i = 0; i < N; ++i) {
+                if (active[i] && skipInterior(pixelRe(row, x + i), row.im, row.maxIter, stats)) {
+                    interior[i] = -1;
+                }
+            }
+            active &= ~interior;
+        }
+
+        Real savedR = zr;
+        Real savedI = zi;
+        Real norm = zr;
+        int saveAt = 1;
+        for (int i = start; i < row.maxIter; ++i) {
+            Real zr2 = rounded(zr * zr);
+            Real zi2 = rounded(zi * zi);
+            if (Smooth) {
+                norm = active ? zr2 + zi2 : norm;
+            }
+            active &= (zr2 + zi2 <= four);
+            if (!anyLane(active)) {
+                break;
+            }
+            iter -= active;
+            Map::step(zr, zi, zr2, zi2, cr, ci, Rounded());
+
+            if (Shortcuts) {
+                Mask repeat = active & (zr == savedR) & (zi == savedI);
+                cycled |= repeat;
+                active &= ~repeat;
+                if (i + 1 - start == saveAt) {
+                    savedR = zr;
+                    savedI = zi;
+                    saveAt *= 2;
+                }
+            }
+        }
+
+        // Only lanes still running at maxIter have a z worth keeping; the
+        // others iterated on after they dropped out.
+        for (int i = 0; i < N; ++i) {
+            if (skipped[i]) {
+                continue;
+            }
+            stats.iterations += iter[i] - start;
+            if (interior[i]) {
+                row.iters[x + i] = row.maxIter;
+            } else if (Shortcuts && cycled[i]) {
+                stats.periodicPixels++;
+                stats.periodicSaved += row.maxIter - iter[i];
+                row.iters[x + i] = row.maxIter;
+            } else {
+                row.iters[x + i] = (int)iter[i];
+            }
+            if (Smooth) {
+                int count = row.iters[x + i];
+                row.smooth[x + i] = count < row.maxIter ? smoothIterations(count, norm[i], Map::POWER) : (float)row.maxIter;
+            }
+            if (row.orbits) {
+                OrbitState state = interior[i] || cycled[i] ? ORBIT_BOUNDED
+                                   : iter[i] < row.maxIter  ? ORBIT_ESCAPED
+                                                            : ORBIT_RUNNING;
+                orbitAt(row, x + i) = { zr[i], zi[i], (int)iter[i], state };
+            }
+        }
+    }
+
+    if (x < row.count) {
+        EscapeRow rest = row;
+        rest.x0 = row.x0 + x * row.step;
+        rest.count = row.count - x;
+        rest.iters = row.iters + x;
+        rest.smooth = Smooth ? row.smooth + x : nullptr;
+        escapeSpanScalarImpl<Scalar, Map, Shortcuts>(rest, stats);
+    }
+}
+
+template <typename Map>
+inline void escapeSpan(const EscapeRow& row, EscapeStats& stats) {
+    if (row.smooth) {
+        if (row.shortcuts) {
+            escapeSpanLanes<Map, true, true>(row, stats);
+        } else {
+            escapeSpanLanes<Map, false, true>(row, stats);
+        }
+    } else if (row.shortcuts) {
+        escapeSpanLanes<Map, true, false>(row, stats);
+    } else {
+        escapeSpanLanes<Map, false, false>(row, stats);
+    }
+}
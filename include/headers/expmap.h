@@ -0,0 +1,135 @@
+#ifndef EXPMAP_H
+#define EXPMAP_H
+
+#include <SDL.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "bigfixed.h"
+#include "framebuffer.h"
+#include "perturbation.h"
+#include "threadpool.h"
+
+// Rows of an exponential map around a centre, for TileRenderer: the pixel in
+// column x of row y is the centre plus r e^(i theta), with theta = 2 pi (x +
+// 1/2) / angles and log r = logOuter - y * logStep. Pixels are computed by
+// perturbation against the centre's orbit, so the map can reach any depth.
+struct ExpMapRows {
+    ReferenceOrbit orbit;
+    int angles;
+    double logOuter;
+    double logStep;
+    int maxIter;
+
+    void operator()(int y, int x0, int step, int count, int* iters, float* smooth, EscapeStats& stats) const {
+        const double TWO_PI = 6.283185307179586;
+        double r = std::exp(logOuter - y * logStep);
+        for (int k = 0; k < count; ++k) {
+            double theta = TWO_PI * (x0 + k * step + 0.5) / angles;
+            iters[k] = perturbedIterations(orbit, r * std::cos(theta), r * std::sin(theta), maxIter, stats,
+                                           smooth ? &smooth[k] : nullptr);
+        }
+    }
+};
+
+// A zoom into a fixed centre, from frames with pixels of startPixel to frames
+// with pixels of endPixel, rendered from a single exponential map instead of
+// frame by frame. Every frame of the zoom is a window of the map's rows: a
+// frame pixel at distance r from the centre is the map's point at log r, and
+// zooming in only shifts log r. The map has enough angles that its points on
+// the frames' outer corners are a frame pixel apart, and its rows are as far
+// apart in log r as its columns are in angle, so its points are square. It
+// runs from the corners of the first frame to half a pixel of the last.
+//
+// After the map is computed and colored once, frame() resamples any frame
+// from it by bilinear interpolation, from per-pixel positions worked out
+// when the zoom is set up.
+class ExpMapZoom {
+public:
+    ExpMapZoom(int frameWidth, int frameHeight, double startPixel, double endPixel)
+        : frameWidth(frameWidth), frameHeight(frameHeight), startPixel(startPixel) {
+        const double TWO_PI = 6.283185307179586;
+        double halfDiagonal = 0.5 * std::hypot((double)frameWidth, (double)frameHeight);
+        angles = std::max(8, (int)std::ceil(TWO_PI * halfDiagonal / 8.0) * 8);
+        logStep = TWO_PI / angles;
+        logOuter = std::log(startPixel * halfDiagonal) + logStep;
+        double logInner = std::log(endPixel * 0.5) - logStep;
+        rows = (int)std::ceil((logOuter - logInner) / logStep) + 1;
+
+        // Position of every frame pixel in the map, for the first frame.
+        column.resize(frameWidth * frameHeight);
+        row.resize(frameWidth * frameHeight);
+        for (int y = 0; y < frameHeight; ++y) {
+            for (int x = 0; x < frameWidth; ++x) {
+                double dx = x + 0.5 - 0.5 * frameWidth, dy = y + 0.5 - 0.5 * frameHeight;
+                double theta = std::atan2(dy, dx);
+                column[y * frameWidth + x] = (float)((theta < 0 ? theta + TWO_PI : theta) / logStep - 0.5);
+                row[y * frameWidth + x] = (float)((logOuter - std::log(startPixel * std::hypot(dx, dy))) / logStep);
+            }
+        }
+    }
+
+    int mapWidth() const {
+        return angles;
+    }
+
+    int mapHeight() const {
+        return rows;
+    }
+
+    ExpMapRows mapRows(const BigFixed& centerRe, const BigFixed& centerIm, double endPixel, int maxIter) const {
+        return { referenceOrbitFor(centerRe, centerIm, endPixel, maxIter), angles, logOuter, logStep, maxIter };
+    }
+
+    // Resamples the frame with pixels of pixelSize from the colored map into
+    // out, pitch pixels between rows.
+    void frame(ThreadPool& pool, const Uint32* map, double pixelSize, Uint32* out, int pitch) const {
+        const int ROWS_PER_CHUNK = 16;
+        float shift = (float)(std::log(startPixel / pixelSize) / logStep);
+        pool.parallelFor((frameHeight + ROWS_PER_CHUNK - 1) / ROWS_PER_CHUNK, [&](int chunk, int) {
+            int end = std::min(frameHeight, (chunk + 1) * ROWS_PER_CHUNK);
+            for (int y = chunk * ROWS_PER_CHUNK; y < end; ++y) {
+                for (int x = 0; x < frameWidth; ++x) {
+                    int index = y * frameWidth + x;
+                    out[y * pitch + x] = sample(map, column[index], row[index] + shift);
+                }
+            }
+        });
+    }
+
+private:
+    // Bilinear interpolation between the four map points around (u, v),
+    // wrapping around in angle and clamped in radius.
+    Uint32 sample(const Uint32* map, float u, float v) const {
+        v = std::min(std::max(v, 0.0f), (float)(rows - 1));
+        int u0 = (int)std::floor(u);
+        int v0 = std::min((int)v, rows - 2);
+        float fu = u - u0, fv = v - v0;
+        u0 = (u0 + angles) % angles;
+        int u1 = u0 + 1 == angles ? 0 : u0 + 1;
+        const Uint32* top = &map[v0 * angles];
+        const Uint32* bottom = top + angles;
+        float weights[4] = { (1 - fu) * (1 - fv), fu * (1 - fv), (1 - fu) * fv, fu * fv };
+        Uint32 corners[4] = { top[u0], top[u1], bottom[u0], bottom[u1] };
+        float channels[3] = { 0.5f, 0.5f, 0.5f };
+        for (int i = 0; i < 4; ++i) {
+            channels[0] += weights[i] * ((corners[i] >> 16) & 0xFF);
+            channels[1] += weights[i] * ((corners[i] >> 8) & 0xFF);
+            channels[2] += weights[i] * (corners[i] & 0xFF);
+        }
+        return packColor((int)channels[0], (int)channels[1], (int)channels[2]);
+    }
+
+    int frameWidth;
+    int frameHeight;
+    double startPixel;
+    int angles;
+    int rows;
+    double logOuter;
+    double logStep;
+    std::vector<float> column;
+    std::vector<float> row;
+};
+
+#endif
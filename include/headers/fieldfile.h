@@ -0,0 +1,86 @@
+#ifndef FIELDFILE_H
+#define FIELDFILE_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// The counts a frame was computed to, kept so it can be colored again in any
+// mode, palette or cycle without iterating: the smooth count of every pixel,
+// and its iteration count.
+struct IterationField {
+    int width = 0;
+    int height = 0;
+    int maxIter = 0;
+    std::vector<int> iters;
+    std::vector<float> smooth;
+};
+
+// A field file holds a header, the smooth counts as float32 and then a byte
+// per pixel: its iteration count less the whole part of its smooth count,
+// which are never far apart. That is 5 bytes a pixel against 8 in memory,
+// and the counts come back exactly. Numbers are in the byte order of the
+// machine that wrote them.
+const uint32_t FIELD_MAGIC = 0x31444C46; // "FLD1"
+
+struct FieldHeader {
+    uint32_t magic;
+    int32_t width;
+    int32_t height;
+    int32_t maxIter;
+};
+
+inline bool saveField(const std::string& path, int width, int height, int maxIter, const int* iters,
+                      const float* smooth) {
+    std::ofstream file(path, std::ios::binary);
+    FieldHeader header = { FIELD_MAGIC, width, height, maxIter };
+    file.write((const char*)&header, sizeof(header));
+    file.write((const char*)smooth, sizeof(float) * width * height);
+    std::vector<int8_t> corrections(width);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            int i = y * width + x;
+            int correction = iters[i] - (int)std::floor(smooth[i]);
+            corrections[x] = (int8_t)std::min(std::max(correction, -128), 127);
+        }
+        file.write((const char*)corrections.data(), width);
+    }
+    return (bool)file;
+}
+
+inline bool loadField(const std::string& path, IterationField& field) {
+    std::ifstream file(path, std::ios::binary);
+    FieldHeader header;
+    if (!file.read((char*)&header, sizeof(header)) || header.magic != FIELD_MAGIC || header.width <= 0 ||
+        header.height <= 0 || header.maxIter <= 0) {
+        return false;
+    }
+
+    // The size must match the header before anything is allocated from it.
+    size_t pixels = (size_t)header.width * header.height;
+    file.seekg(0, std::ios::end);
+    if ((unsigned long long)file.tellg() != sizeof(header) + (unsigned long long)pixels * (sizeof(float) + 1)) {
+        return false;
+    }
+    file.seekg(sizeof(header));
+    field.width = header.width;
+    field.height = header.height;
+    field.maxIter = header.maxIter;
+    field.smooth.resize(pixels);
+    field.iters.resize(pixels);
+    std::vector<int8_t> corrections(pixels);
+    if (!file.read((char*)field.smooth.data(), sizeof(float) * pixels) ||
+        !file.read((char*)corrections.data(), pixels)) {
+        return false;
+    }
+    for (size_t i = 0; i < pixels; ++i) {
+        int count = (int)std::floor(field.smooth[i]) + corrections[i];
+        field.iters[i] = std::min(std::max(count, 0), field.maxIter);
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,198 @@
+#ifndef FIXEDPOINT_H
+#define FIXEDPOINT_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+// Signed fixed-point number of Limbs 64-bit limbs in two's complement, little
+// endian, with INTEGER_BITS bits above the binary point, sign included: 2 to
+// 16 limbs hold 128 to 1024 bits, all but 8 of them fraction, and values in
+// [-128, 128), which z^2 + c stays within until it escapes.
+//
+// The limb count is a template parameter, so every loop has a fixed trip
+// count the compiler can unroll and numbers live on the stack, where
+// BigFixed allocates for every result. Limbs are multiplied 64 x 64 -> 128
+// bits at a time, and partial products more than a limb below the kept bits
+// are skipped. square() computes each cross product once and doubles it,
+// close to half the multiplies of a product. Products are truncated, not
+// rounded, like BigFixed's, but the carries of the skipped partial products
+// are lost with them, so a product can come out one unit in the last place
+// below the exact truncation: it agrees with BigFixed to within the last
+// bit, not bit for bit.
+template <int Limbs>
+class FixedPoint {
+public:
+    static_assert(Limbs >= 2 && Limbs <= 16, "FixedPoint holds 128 to 1024 bits");
+
+    static const int INTEGER_BITS = 8;
+    static const int FRACTION_BITS = 64 * Limbs - INTEGER_BITS;
+
+    FixedPoint(double value = 0.0) : limb() {
+        double rest = std::ldexp(std::fabs(value), 64 - INTEGER_BITS);
+        for (int i = Limbs - 1; i >= 0 && rest > 0.0; --i) {
+            double whole = std::floor(rest);
+            limb[i] = (uint64_t)whole;
+            rest = std::ldexp(rest - whole, 64);
+        }
+        if (value < 0.0) {
+            negate();
+        }
+    }
+
+    bool isNegative() const {
+        return (int64_t)limb[Limbs - 1] < 0;
+    }
+
+    // From the top two limbs, which hold more bits than a double.
+    double toDouble() const {
+        return std::ldexp((double)(int64_t)limb[Limbs - 1], INTEGER_BITS - 64) +
+               std::ldexp((double)limb[Limbs - 2], INTEGER_BITS - 128);
+    }
+
+    FixedPoint operator-() const {
+        FixedPoint result = *this;
+        result.negate();
+        return result;
+    }
+
+    FixedPoint operator+(const FixedPoint& other) const {
+        FixedPoint result;
+        uint64_t carry = 0;
+        for (int i = 0; i < Limbs; ++i) {
+            uint64_t sum = limb[i] + other.limb[i];
+            uint64_t wrapped = sum < limb[i];
+            result.limb[i] = sum + carry;
+            carry = wrapped | (result.limb[i] < sum);
+        }
+        return result;
+    }
+
+    FixedPoint operator-(const FixedPoint& other) const {
+        FixedPoint result;
+        uint64_t borrow = 0;
+        for (int i = 0; i < Limbs; ++i) {
+            uint64_t difference = limb[i] - other.limb[i];
+            uint64_t wrapped = limb[i] < other.limb[i];
+            result.limb[i] = difference - borrow;
+            borrow = wrapped | (difference < borrow);
+        }
+        return result;
+    }
+
+    FixedPoint operator*(const FixedPoint& other) const {
+        FixedPoint a = isNegative() ? -*this : *this;
+        FixedPoint b = other.isNegative() ? -other : other;
+        uint64_t product[2 * Limbs] = {};
+        for (int i = 0; i < Limbs; ++i) {
+            uint64_t carry = 0;
+            for (int j = lowest(i); j < Limbs; ++j) {
+                multiplyAdd(a.limb[i], b.limb[j], product[i + j], carry);
+            }
+            product[i + Limbs] = carry;
+        }
+        FixedPoint result = fromProduct(product);
+        return isNegative() != other.isNegative() ? -result : result;
+    }
+
+    FixedPoint square() const {
+        FixedPoint a = isNegative() ? -*this : *this;
+        uint64_t product[2 * Limbs] = {};
+        for (int i = 0; i < Limbs; ++i) {
+            uint64_t carry = 0;
+            for (int j = std::max(i + 1, lowest(i)); j < Limbs; ++j) {
+                multiplyAdd(a.limb[i], a.limb[j], product[i + j], carry);
+            }
+            product[i + Limbs] = carry;
+        }
+        for (int i = 2 * Limbs - 1; i > 0; --i) {
+            product[i] = (product[i] << 1) | (product[i - 1] >> 63);
+        }
+        product[0] <<= 1;
+        uint64_t carry = 0;
+        for (int i = 0; i < Limbs; ++i) {
+            uint64_t high;
+            uint64_t low = multiplyWide(a.limb[i], a.limb[i], high);
+            addWithCarry(product[2 * i], low, carry);
+            addWithCarry(product[2 * i + 1], high, carry);
+        }
+        return fromProduct(product);
+    }
+
+    bool operator>(double value) const {
+        return toDouble() > value;
+    }
+
+private:
+    static int lowest(int i) {
+        return i < Limbs - 2 ? Limbs - 2 - i : 0;
+    }
+
+    static uint64_t multiplyWide(uint64_t a, uint64_t b, uint64_t& high) {
+#ifdef __SIZEOF_INT128__
+        unsigned __int128 product = (unsigned __int128)a * b;
+        high = (uint64_t)(product >> 64);
+        return (uint64_t)product;
+#else
+        uint64_t aLow = (uint32_t)a, aHigh = a >> 32, bLow = (uint32_t)b, bHigh = b >> 32;
+        uint64_t low = aLow * bLow, middle1 = aHigh * bLow, middle2 = aLow * bHigh;
+        uint64_t middle = (low >> 32) + (uint32_t)middle1 + (uint32_t)middle2;
+        high = aHigh * bHigh + (middle1 >> 32) + (middle2 >> 32) + (middle >> 32);
+        return (middle << 32) | (uint32_t)low;
+#endif
+    }
+
+    // sum += a * b + carry, leaving the bits above sum in carry.
+    static void multiplyAdd(uint64_t a, uint64_t b, uint64_t& sum, uint64_t& carry) {
+        uint64_t high;
+        uint64_t low = multiplyWide(a, b, high);
+        low += sum;
+        high += low < sum;
+        low += carry;
+        high += low < carry;
+        sum = low;
+        carry = high;
+    }
+
+    static void addWithCarry(uint64_t& sum, uint64_t value, uint64_t& carry) {
+        uint64_t total = sum + value;
+        uint64_t wrapped = total < value;
+        sum = total + carry;
+        carry = wrapped | (sum < total);
+    }
+
+    // The Limbs limbs of a 2 * Limbs product of magnitudes from bit
+    // FRACTION_BITS up.
+    static FixedPoint fromProduct(const uint64_t* product) {
+        const int SHIFT = FRACTION_BITS % 64;
+        const int OFFSET = FRACTION_BITS / 64;
+        FixedPoint result;
+        for (int i = 0; i < Limbs; ++i) {
+            result.limb[i] = (product[OFFSET + i] >> SHIFT) |
+                             (OFFSET + i + 1 < 2 * Limbs ? product[OFFSET + i + 1] << (64 - SHIFT) : 0);
+        }
+        return result;
+    }
+
+    void negate() {
+        uint64_t carry = 1;
+        for (int i = 0; i < Limbs; ++i) {
+            limb[i] = ~limb[i] + carry;
+            carry = carry && limb[i] == 0;
+        }
+    }
+
+    uint64_t limb[Limbs];
+};
+
+template <int Limbs>
+inline double toDouble(const FixedPoint<Limbs>& value) {
+    return value.toDouble();
+}
+
+template <int Limbs>
+inline FixedPoint<Limbs> square(const FixedPoint<Limbs>& value) {
+    return value.square();
+}
+
+#endif
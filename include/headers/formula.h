@@ -0,0 +1,188 @@
+#ifndef FORMULA_H
+#define FORMULA_H
+
+#include <cmath>
+
+// Iteration maps for the escape-time kernels, as compile-time policies. A map
+// provides:
+//
+//   POWER           the degree of the map, which sets the smooth count
+//   JULIA           true if c is fixed (the row's seed) and the pixel is z0
+//   INTERIOR_TESTS  true if the Mandelbrot cardioid and bulb tests apply
+//   DISTANCE_ESTIMATE
+//                   true if the map is z^POWER + c, so distanceEstimate works
+//   step(zr, zi, zr2, zi2, cr, ci, round)
+//                   z -> f(z) + c, given zr2 = zr^2 and zi2 = zi^2
+//
+// step is written once for float, double and the lane vectors. Every product
+// that feeds an add is passed to round(product) first, which the lane kernels
+// use to keep the compiler from fusing them, so all paths give the same
+// counts. round works in place so no vector is returned by value from code
+// built for the baseline target.
+//
+// The lane kernels are compiled per instruction set under a target pragma,
+// and GCC will not inline a function built for the baseline target into one
+// built for AVX2 or AVX-512 on its own; FORMULA_INLINE forces the policies
+// into each kernel so they get that kernel's vector registers.
+
+#if defined(__GNUC__)
+#define FORMULA_INLINE inline __attribute__((always_inline))
+#else
+#define FORMULA_INLINE inline
+#endif
+
+enum Formula { FORMULA_MANDELBROT, FORMULA_JULIA, FORMULA_MULTIBROT3, FORMULA_MULTIBROT4, FORMULA_BURNING_SHIP };
+
+const Formula ALL_FORMULAS[] = { FORMULA_MANDELBROT, FORMULA_JULIA, FORMULA_MULTIBROT3, FORMULA_MULTIBROT4,
+                                 FORMULA_BURNING_SHIP };
+
+inline const char* formulaName(Formula formula) {
+    switch (formula) {
+        case FORMULA_JULIA: return "julia";
+        case FORMULA_MULTIBROT3: return "multibrot3";
+        case FORMULA_MULTIBROT4: return "multibrot4";
+        case FORMULA_BURNING_SHIP: return "burning-ship";
+        default: return "mandelbrot";
+    }
+}
+
+// z^2 + c.
+struct MandelbrotMap {
+    static const int POWER = 2;
+    static const bool JULIA = false;
+    static const bool INTERIOR_TESTS = true;
+    static const bool DISTANCE_ESTIMATE = true;
+
+    template <typename Real, typename C, typename Round>
+    static FORMULA_INLINE void step(Real& zr, Real& zi, const Real& zr2, const Real& zi2, const Real& cr, const C& ci, Round round) {
+        Real twice = (zr + zr) * zi;
+        round(twice);
+        zi = twice + ci;
+        zr = zr2 - zi2 + cr;
+    }
+};
+
+// z^2 + c with c fixed and z0 the pixel.
+struct JuliaMap : MandelbrotMap {
+    static const bool JULIA = true;
+    static const bool INTERIOR_TESTS = false;
+};
+
+// z^N for a fixed N >= 1, by repeated squaring and multiplication that the
+// compiler unrolls completely.
+template <int N>
+struct ComplexPower {
+    template <typename Real, typename Round>
+    static FORMULA_INLINE void apply(const Real& zr, const Real& zi, Real& pr, Real& pi, Round round) {
+        Real hr, hi;
+        if (N % 2 == 0) {
+            ComplexPower<N / 2>::apply(zr, zi, hr, hi, round);
+            Real rr = hr * hr, ii = hi * hi;
+            round(rr);
+            round(ii);
+            pr = rr - ii;
+            pi = (hr + hr) * hi;
+            round(pi);
+        } else {
+            ComplexPower<N - 1>::apply(zr, zi, hr, hi, round);
+            Real rr = hr * zr, ii = hi * zi, ri = hr * zi, ir = hi * zr;
+            round(rr);
+            round(ii);
+            round(ri);
+            round(ir);
+            pr = rr - ii;
+            pi = ri + ir;
+        }
+    }
+};
+
+template <>
+struct ComplexPower<1> {
+    template <typename Real, typename Round>
+    static FORMULA_INLINE void apply(const Real& zr, const Real& zi, Real& pr, Real& pi, Round) {
+        pr = zr;
+        pi = zi;
+    }
+};
+
+// z^N + c.
+template <int N>
+struct MultibrotMap {
+    static const int POWER = N;
+    static const bool JULIA = false;
+    static const bool INTERIOR_TESTS = false;
+    static const bool DISTANCE_ESTIMATE = true;
+
+    template <typename Real, typename C, typename Round>
+    static FORMULA_INLINE void step(Real& zr, Real& zi, const Real&, const Real&, const Real& cr, const C& ci, Round round) {
+        Real pr, pi;
+        ComplexPower<N>::apply(zr, zi, pr, pi, round);
+        zr = pr + cr;
+        zi = pi + ci;
+    }
+};
+
+// (|Re z| + i |Im z|)^2 + c. Folding z is not complex-differentiable, so it
+// has no distance estimate.
+struct BurningShipMap {
+    static const int POWER = 2;
+    static const bool JULIA = false;
+    static const bool INTERIOR_TESTS = false;
+    static const bool DISTANCE_ESTIMATE = false;
+
+    template <typename Real, typename C, typename Round>
+    static FORMULA_INLINE void step(Real& zr, Real& zi, const Real& zr2, const Real& zi2, const Real& cr, const C& ci, Round round) {
+        Real twice = (zr + zr) * zi;
+        round(twice);
+        zi = (twice < 0 ? -twice : twice) + ci;
+        zr = zr2 - zi2 + cr;
+    }
+};
+
+// Distance from the pixel (pr, pi) to the set, estimated as |z| log|z| / |dz|
+// from the derivative dz of the orbit with respect to the pixel, carried
+// alongside z: dz -> POWER z^(POWER - 1) dz, plus 1 if the pixel is c. This is
+// within a factor of four of the true distance. The orbit runs to a much
+// larger radius than the kernels' 2 so the estimate settles, which takes a
+// few iterations past maxIter for pixels that escape just before it. Returns
+// 0 for pixels that stay bounded and -1 if the map has no estimate.
+template <typename Map>
+double distanceEstimate(double pr, double pi, double seedRe, double seedIm, int maxIter) {
+    if (!Map::DISTANCE_ESTIMATE) {
+        return -1.0;
+    }
+    const double BAILOUT = 1e10; // |z|^2
+    const int EXTRA_ITERATIONS = 64;
+    auto exact = [](double&) {};
+    double cr = Map::JULIA ? seedRe : pr, ci = Map::JULIA ? seedIm : pi;
+    double zr = Map::JULIA ? pr : 0.0, zi = Map::JULIA ? pi : 0.0;
+    double dr = Map::JULIA ? 1.0 : 0.0, di = 0.0;
+    for (int iter = 0; iter < maxIter + EXTRA_ITERATIONS; ++iter) {
+        double zr2 = zr * zr, zi2 = zi * zi;
+        double norm = zr2 + zi2;
+        if (norm > BAILOUT) {
+            return 0.5 * std::sqrt(norm) * std::log(norm) / std::hypot(dr, di);
+        }
+        double qr, qi;
+        ComplexPower<Map::POWER - 1>::apply(zr, zi, qr, qi, exact);
+        double nextDr = Map::POWER * (qr * dr - qi * di) + (Map::JULIA ? 0.0 : 1.0);
+        di = Map::POWER * (qr * di + qi * dr);
+        dr = nextDr;
+        Map::step(zr, zi, zr2, zi2, cr, ci, exact);
+    }
+    return 0.0;
+}
+
+typedef double (*DistanceEstimateFn)(double pr, double pi, double seedRe, double seedIm, int maxIter);
+
+inline DistanceEstimateFn distanceEstimateFor(Formula formula) {
+    switch (formula) {
+        case FORMULA_JULIA: return &distanceEstimate<JuliaMap>;
+        case FORMULA_MULTIBROT3: return &distanceEstimate<MultibrotMap<3>>;
+        case FORMULA_MULTIBROT4: return &distanceEstimate<MultibrotMap<4>>;
+        case FORMULA_BURNING_SHIP: return &distanceEstimate<BurningShipMap>;
+        default: return &distanceEstimate<MandelbrotMap>;
+    }
+}
+
+#endif
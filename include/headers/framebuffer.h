@@ -0,0 +1,82 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include <SDL.h>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+inline Uint32 packColor(int r, int g, int b) {
+    return 0xFF000000u | ((Uint32)r << 16) | ((Uint32)g << 8) | (Uint32)b;
+}
+
+// CPU-side ARGB8888 image backed by a streaming texture. Simulations write
+// pixels straight into the buffer and present() uploads it once per frame
+// and draws it with a single SDL_RenderCopy, stretched over the whole window.
+class Framebuffer {
+public:
+    Framebuffer(SDL_Renderer* renderer, int width, int height)
+        : renderer(renderer), width(width), height(height), pixels(width * height, packColor(0, 0, 0)) {
+        texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, width, height);
+    }
+
+    ~Framebuffer() {
+        if (texture) {
+            SDL_DestroyTexture(texture);
+        }
+    }
+
+    Framebuffer(const Framebuffer&) = delete;
+    Framebuffer& operator=(const Framebuffer&) = delete;
+
+    bool valid() const {
+        return texture != nullptr;
+    }
+
+    int getWidth() const {
+        return width;
+    }
+
+    int getHeight() const {
+        return height;
+    }
+
+    Uint32* data() {
+        return pixels.data();
+    }
+
+    Uint32* row(int y) {
+        return &pixels[y * width];
+    }
+
+    void setPixel(int x, int y, Uint32 color) {
+        pixels[y * width + x] = color;
+    }
+
+    void clear(Uint32 color) {
+        std::fill(pixels.begin(), pixels.end(), color);
+    }
+
+    void present() {
+        void* target;
+        int pitch;
+        if (SDL_LockTexture(texture, nullptr, &target, &pitch) == 0) {
+            Uint8* dst = (Uint8*)target;
+            for (int y = 0; y < height; ++y) {
+                std::memcpy(dst + y * pitch, &pixels[y * width], width * sizeof(Uint32));
+            }
+            SDL_UnlockTexture(texture);
+        }
+        SDL_RenderCopy(renderer, texture, nullptr, nullptr);
+        SDL_RenderPresent(renderer);
+    }
+
+private:
+    SDL_Renderer* renderer;
+    SDL_Texture* texture;
+    int width;
+    int height;
+    std::vector<Uint32> pixels;
+};
+
+#endif
@@ -0,0 +1,112 @@
+#ifndef FRAMEWRITER_H
+#define FRAMEWRITER_H
+
+#include <SDL.h>
+#include <SDL_image.h>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "threadpool.h"
+
+// Saves finished frames as PNGs on a thread pool while the caller computes
+// the next ones: compute and coloring run on the pool from the caller, and
+// every frame handed to write() is encoded and written by a pool task of its
+// own, so frames are computed while earlier ones are still being written and
+// the workers that the compute leaves idle encode.
+//
+// Frames are drawn into surfaces from acquire(), which come back for reuse
+// once written. At most maxPending frames wait to be written; acquire()
+// blocks until one of them is done, which holds memory to maxPending + 1
+// frames however far ahead the compute gets.
+class FrameWriter {
+public:
+    FrameWriter(ThreadPool& pool, int maxPending) : pool(pool), maxPending(maxPending < 1 ? 1 : maxPending) {
+    }
+
+    ~FrameWriter() {
+        finish();
+        for (SDL_Surface* surface : spare) {
+            SDL_FreeSurface(surface);
+        }
+    }
+
+    FrameWriter(const FrameWriter&) = delete;
+    FrameWriter& operator=(const FrameWriter&) = delete;
+
+    // A width x height surface to draw the next frame into, or null if none
+    // could be created.
+    SDL_Surface* acquire(int width, int height) {
+        std::unique_lock<std::mutex> lock(mutex);
+        written.wait(lock, [&] { return !spare.empty() || surfaces < maxPending + 1; });
+        SDL_Surface* surface = nullptr;
+        if (!spare.empty()) {
+            surface = spare.back();
+            spare.pop_back();
+            if (surface->w != width || surface->h != height) {
+                SDL_FreeSurface(surface);
+                surface = nullptr;
+                surfaces--;
+            }
+        }
+        if (!surface) {
+            surface = SDL_CreateRGBSurfaceWithFormat(0, width, height, 32, SDL_PIXELFORMAT_ARGB8888);
+            if (!surface) {
+                std::cout << "Surface could not be created! SDL_Error: " << SDL_GetError() << std::endl;
+                return nullptr;
+            }
+            surfaces++;
+        }
+        return surface;
+    }
+
+    // Saves surface, from acquire(), as path on the pool.
+    void write(SDL_Surface* surface, const std::string& path) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending++;
+        }
+        pool.submit([this, surface, path] {
+            bool saved = IMG_SavePNG(surface, path.c_str()) == 0;
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!saved) {
+                std::cout << "Could not save " << path << "! SDL_Error: " << IMG_GetError() << std::endl;
+                failures++;
+            }
+            spare.push_back(surface);
+            pending--;
+            written.notify_all();
+        });
+    }
+
+    // Returns a surface from acquire() unwritten.
+    void release(SDL_Surface* surface) {
+        std::lock_guard<std::mutex> lock(mutex);
+        spare.push_back(surface);
+        written.notify_all();
+    }
+
+    // Waits until every frame is written and returns how many could not be
+    // saved since the last call.
+    int finish() {
+        std::unique_lock<std::mutex> lock(mutex);
+        written.wait(lock, [&] { return pending == 0; });
+        int failed = failures;
+        failures = 0;
+        return failed;
+    }
+
+private:
+    ThreadPool& pool;
+    int maxPending;
+    std::mutex mutex;
+    std::condition_variable written;
+    std::vector<SDL_Surface*> spare;
+    int surfaces = 0;
+    int pending = 0;
+    int failures = 0;
+};
+
+#endif
@@ -0,0 +1,99 @@
+#ifndef ITERCAP_H
+#define ITERCAP_H
+
+#include <algorithm>
+#include <vector>
+
+// Escape times of a finished frame computed with a cap: the pixels that
+// reached it, those that escaped in the octave below it and in the octave
+// before that, and the earliest time after which at most allowed pixels
+// escaped.
+struct EscapeProfile {
+    long long pixels = 0;
+    long long capped = 0;
+    long long lastOctave = 0;
+    long long octaveBefore = 0;
+    int tail = 0;
+};
+
+inline EscapeProfile profileEscapes(const int* iters, int count, int cap, long long allowed) {
+    EscapeProfile profile;
+    std::vector<int> histogram(cap + 1, 0);
+    for (int i = 0; i < count; ++i) {
+        histogram[std::min(std::max(iters[i], 0), cap)]++;
+    }
+    profile.pixels = count;
+    profile.capped = histogram[cap];
+    for (int n = cap / 4; n < cap; ++n) {
+        (n >= cap / 2 ? profile.lastOctave : profile.octaveBefore) += histogram[n];
+    }
+    long long later = 0;
+    profile.tail = cap;
+    while (profile.tail > 0 && later + histogram[profile.tail - 1] <= allowed) {
+        later += histogram[--profile.tail];
+    }
+    return profile;
+}
+
+// Picks the iteration cap of the next frame from the escape times of the
+// last one: the smallest cap at which doubling it would change fewer than
+// unstable of the pixels, the same test deepening stops at.
+//
+// Pixels that reach the cap are either inside the set or would escape with a
+// higher one. Escape times fall off roughly geometrically towards the cap, so
+// the pixels escaping in the octave above it are estimated as those of the
+// octave below it, times the ratio of that octave to the one before. While
+// the estimate is over the limit the cap is doubled, by at most MAX_RAISE
+// octaves at a time: the tails are often longer than geometric, and raising
+// again after the next frame costs less than overshooting. Otherwise it is
+// lowered to a power of two at least twice the time after which too few
+// pixels escape to matter, which leaves an octave of headroom, so that a cap
+// that was just raised is not lowered again by the next frame. Caps stay
+// between minCap and maxCap, and only move in whole octaves, so colors scaled
+// to the cap do not flicker from frame to frame. A frame where nothing
+// escaped may lie inside the set or need a far higher cap; it is raised as
+// far as one step goes, which cycle detection keeps cheap for pixels inside
+// the set.
+class IterationCapController {
+public:
+    IterationCapController(int minCap, int maxCap, double unstable) : minCap(minCap), maxCap(maxCap), unstable(unstable) {
+    }
+
+    int nextCap(const int* iters, int count, int cap, EscapeProfile* out = nullptr) const {
+        long long allowed = (long long)(unstable * count);
+        EscapeProfile profile = profileEscapes(iters, count, cap, allowed);
+        if (out) {
+            *out = profile;
+        }
+        double ratio = 2.0;
+        double estimate = allowed + 1.0;
+        if (profile.capped < profile.pixels) {
+            ratio = profile.octaveBefore > 0 ? (double)profile.lastOctave / profile.octaveBefore
+                                             : profile.lastOctave > 0 ? 1.0 : 0.0;
+            estimate = profile.lastOctave * std::min(ratio, 1.0);
+        }
+        if (estimate > allowed && profile.capped > 0) {
+            int next = cap;
+            int octaves = 0;
+            do {
+                next = next > maxCap / 2 ? maxCap : next * 2;
+                estimate *= ratio;
+            } while (++octaves < MAX_RAISE && estimate > allowed && next < maxCap);
+            return std::max(next, cap);
+        }
+        int next = minCap;
+        while (next < 2 * profile.tail && next < maxCap) {
+            next = next > maxCap / 2 ? maxCap : next * 2;
+        }
+        return std::min(next, std::max(cap, minCap));
+    }
+
+private:
+    static const int MAX_RAISE = 2;
+
+    int minCap;
+    int maxCap;
+    double unstable;
+};
+
+#endif
@@ -0,0 +1,159 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Whether path holds something that does not start with magic. Mapping a
+// file grows it and writes into it, so files that hold something else are
+// refused rather than overwritten; a missing or empty file is not foreign.
+inline bool isForeignFile(const std::string& path, uint32_t magic) {
+    std::ifstream file(path, std::ios::binary);
+    uint32_t stored = 0;
+    if (!file || file.peek() == std::ifstream::traits_type::eof()) {
+        return false;
+    }
+    return !file.read((char*)&stored, sizeof(stored)) || stored != magic;
+}
+
+// A file mapped read/write into memory. open() creates the file if needed and
+// grows it to at least size bytes; new space reads as zeros.
+class MappedFile {
+public:
+    MappedFile() {
+    }
+
+    ~MappedFile() {
+        close();
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string& path, size_t size) {
+        close();
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+                           OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        LARGE_INTEGER existing;
+        GetFileSizeEx(file, &existing);
+        if ((size_t)existing.QuadPart > size) {
+            size = (size_t)existing.QuadPart;
+        }
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, (DWORD)((unsigned long long)size >> 32),
+                                     (DWORD)(size & 0xFFFFFFFFu), nullptr);
+        if (!mapping) {
+            close();
+            return false;
+        }
+        bytes = (unsigned char*)MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+#else
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat info;
+        if (fstat(fd, &info) == 0 && (size_t)info.st_size > size) {
+            size = (size_t)info.st_size;
+        } else if (ftruncate(fd, (off_t)size) != 0) {
+            close();
+            return false;
+        }
+        void* mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        bytes = mapped == MAP_FAILED ? nullptr : (unsigned char*)mapped;
+#endif
+        if (!bytes) {
+            close();
+            return false;
+        }
+        length = size;
+        return true;
+    }
+
+    // Starts writing changed pages back to the file; with wait set, returns
+    // only once they are on disk.
+    void flush(bool wait = false) {
+        if (!bytes) {
+            return;
+        }
+#ifdef _WIN32
+        FlushViewOfFile(bytes, 0);
+        if (wait) {
+            FlushFileBuffers(file);
+        }
+#else
+        msync(bytes, length, wait ? MS_SYNC : MS_ASYNC);
+#endif
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (bytes) {
+            UnmapViewOfFile(bytes);
+        }
+        if (mapping) {
+            CloseHandle(mapping);
+        }
+        if (file != INVALID_HANDLE_VALUE) {
+            CloseHandle(file);
+        }
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (bytes) {
+            munmap(bytes, length);
+        }
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        fd = -1;
+#endif
+        bytes = nullptr;
+        length = 0;
+    }
+
+    bool isOpen() const {
+        return bytes != nullptr;
+    }
+
+    unsigned char* data() {
+        return bytes;
+    }
+
+    const unsigned char* data() const {
+        return bytes;
+    }
+
+    size_t size() const {
+        return length;
+    }
+
+private:
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#else
+    int fd = -1;
+#endif
+    unsigned char* bytes = nullptr;
+    size_t length = 0;
+};
+
+#endif
@@ -0,0 +1,227 @@
+#ifndef PALETTE_H
+#define PALETTE_H
+
+#include <SDL.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "framebuffer.h"
+#include "threadpool.h"
+
+// Black at both ends, through blue, orange and yellow in between.
+inline void polynomialGradient(double t, int& r, int& g, int& b) {
+    r = (int)(9 * (1 - t) * t * t * t * 255);
+    g = (int)(15 * (1 - t) * (1 - t) * t * t * 255);
+    b = (int)(8.5 * (1 - t) * (1 - t) * (1 - t) * t * 255);
+}
+
+// Banded colors one flat color per iteration count, smooth uses the
+// fractional counts, and histogram spreads the gradient evenly over the
+// pixels actually in the frame (histogram equalization).
+enum ColorMode { COLOR_BANDED, COLOR_SMOOTH, COLOR_HISTOGRAM };
+
+inline const char* colorModeName(ColorMode mode) {
+    switch (mode) {
+        case COLOR_SMOOTH: return "smooth";
+        case COLOR_HISTOGRAM: return "histogram";
+        default: return "banded";
+    }
+}
+
+// Turns iteration counts into colors by table lookup. The gradient is
+// evaluated once per table entry instead of once per pixel: for every count
+// up to maxIter in banded mode, at GRADIENT_SIZE points for fractional
+// positions. Pixels that reach maxIter are black; counts outside [0,
+// maxIter], as from a frame with another cap, are taken as the nearest end.
+//
+// setCycle() turns the gradient around by a share of its length, wrapping
+// past its end, for color cycling: it only rebuilds the per-count tables, so
+// recoloring a frame from its counts after every step costs no iterations.
+class Palette {
+public:
+    typedef void (*GradientFn)(double t, int& r, int& g, int& b);
+
+    static constexpr int GRADIENT_SIZE = 8192;
+
+    explicit Palette(GradientFn gradient = polynomialGradient) : gradient(gradient), gradientTable(GRADIENT_SIZE + 1) {
+        for (int i = 0; i <= GRADIENT_SIZE; ++i) {
+            gradientTable[i] = color((double)i / GRADIENT_SIZE);
+        }
+    }
+
+    // Rebuilds the tables for counts up to maxIter; cheap if it is unchanged.
+    void setMaxIter(int cap) {
+        if (cap == maxIter) {
+            return;
+        }
+        maxIter = cap;
+        levels.assign(maxIter + 1, 0.0f);
+        levels[maxIter] = (float)GRADIENT_SIZE;
+        buildBands();
+        equalizedBands = bands;
+    }
+
+    // Turns the gradient by phase of its length, from 0 (as it is) to 1.
+    // Returns whether the colors changed, which they only do in steps of a
+    // gradient table entry.
+    bool setCycle(double phase) {
+        phase -= std::floor(phase);
+        int next = std::min((int)(phase * GRADIENT_SIZE), GRADIENT_SIZE - 1);
+        if (next == shift) {
+            return false;
+        }
+        shift = next;
+        buildBands();
+        buildEqualizedBands();
+        return true;
+    }
+
+    // Builds the histogram of the escaped pixels' counts for COLOR_HISTOGRAM.
+    // Each thread counts a share of the pixels into its own bins, and the bins
+    // are summed at the end. Neighbouring pixels mostly share a count, so every
+    // thread keeps four interleaved sets of bins to keep the increments from
+    // waiting on each other, unless the cap is past SHARED_SET_CAP: bins that
+    // no longer fit in the cache cost more to clear and sum four times over
+    // than the waits do, and the sets are then all one.
+    void equalize(ThreadPool& pool, const int* iters, int count) {
+        const int CHUNKS = 64;
+        const int SETS = 4;
+        const int SHARED_SET_CAP = 1 << 14;
+        int stride = maxIter + 1;
+        int cap = maxIter;
+        int sets = cap <= SHARED_SET_CAP ? SETS : 1;
+        std::vector<std::vector<int>> slotBins(pool.size() + 1);
+        pool.parallelFor(CHUNKS, [&](int chunk, int slot) {
+            std::vector<int>& bins = slotBins[slot];
+            if (bins.empty()) {
+                bins.assign(sets * stride, 0);
+            }
+            int* set0 = &bins[0];
+            int* set1 = sets == SETS ? &bins[stride] : set0;
+            int* set2 = sets == SETS ? &bins[2 * stride] : set0;
+            int* set3 = sets == SETS ? &bins[3 * stride] : set0;
+            int i = (int)((long long)count * chunk / CHUNKS);
+            int end = (int)((long long)count * (chunk + 1) / CHUNKS);
+            for (; i + SETS <= end; i += SETS) {
+                set0[std::min(std::max(iters[i], 0), cap)]++;
+                set1[std::min(std::max(iters[i + 1], 0), cap)]++;
+                set2[std::min(std::max(iters[i + 2], 0), cap)]++;
+                set3[std::min(std::max(iters[i + 3], 0), cap)]++;
+            }
+            for (; i < end; ++i) {
+                set0[std::min(std::max(iters[i], 0), cap)]++;
+            }
+        });
+
+        // The bins grow with the cap rather than the frame, so they are
+        // summed on the pool too, a range of counts per task.
+        std::vector<long long> total(stride, 0);
+        pool.parallelFor(CHUNKS, [&](int chunk, int) {
+            int begin = (int)((long long)stride * chunk / CHUNKS);
+            int end = (int)((long long)stride * (chunk + 1) / CHUNKS);
+            for (const std::vector<int>& bins : slotBins) {
+                for (int set = 0; set < (int)bins.size(); set += stride) {
+                    const int* counts = &bins[set];
+                    for (int k = begin; k < end; ++k) {
+                        total[k] += counts[k];
+                    }
+                }
+            }
+        });
+        long long escaped = 0;
+        for (int i = 0; i < maxIter; ++i) {
+            escaped += total[i];
+        }
+
+        // levels[k] is the share of escaped pixels with fewer than k
+        // iterations, scaled to an index into the gradient table.
+        long long below = 0;
+        for (int k = 0; k <= maxIter; ++k) {
+            levels[k] = escaped > 0 ? (float)((double)below / escaped * GRADIENT_SIZE) : 0.0f;
+            below += k < maxIter ? total[k] : 0;
+        }
+        buildEqualizedBands();
+    }
+
+    // Smooth counts below zero, from points far outside the set that escape
+    // at once, take the first color of the gradient.
+    void colorRow(ColorMode mode, const int* iters, const float* smooth, Uint32* out, int count) const {
+        if (mode == COLOR_SMOOTH && smooth) {
+            const Uint32* table = gradientTable.data();
+            float scale = (float)GRADIENT_SIZE / maxIter;
+            Uint32 black = bands[maxIter];
+            for (int x = 0; x < count; ++x) {
+                int index = std::min(std::max((int)(smooth[x] * scale), 0), GRADIENT_SIZE) + shift;
+                index -= index > GRADIENT_SIZE ? GRADIENT_SIZE : 0;
+                out[x] = iters[x] < maxIter ? table[index] : black;
+            }
+        } else if (mode == COLOR_HISTOGRAM && smooth) {
+            // Interpolates between the levels of the two counts around the
+            // smooth count, in units of gradient table entries.
+            const Uint32* table = gradientTable.data();
+            const float* level = levels.data();
+            Uint32 black = bands[maxIter];
+            for (int x = 0; x < count; ++x) {
+                int i = std::min(std::max((int)smooth[x], 0), maxIter - 1);
+                float position = level[i] + (smooth[x] - i) * (level[i + 1] - level[i]);
+                int index = std::min(std::max((int)position, 0), GRADIENT_SIZE) + shift;
+                index -= index > GRADIENT_SIZE ? GRADIENT_SIZE : 0;
+                out[x] = iters[x] < maxIter ? table[index] : black;
+            }
+        } else {
+            const Uint32* table = mode == COLOR_HISTOGRAM ? equalizedBands.data() : bands.data();
+            for (int x = 0; x < count; ++x) {
+                out[x] = table[std::min(std::max(iters[x], 0), maxIter)];
+            }
+        }
+    }
+
+    // Colors a whole width x height frame on the pool. pitch is the distance
+    // between output rows in pixels.
+    void colorFrame(ThreadPool& pool, ColorMode mode, const int* iters, const float* smooth, int width, int height,
+                    Uint32* out, int pitch) const {
+        const int ROWS_PER_CHUNK = 16;
+        pool.parallelFor((height + ROWS_PER_CHUNK - 1) / ROWS_PER_CHUNK, [&](int chunk, int) {
+            int end = std::min(height, (chunk + 1) * ROWS_PER_CHUNK);
+            for (int y = chunk * ROWS_PER_CHUNK; y < end; ++y) {
+                colorRow(mode, &iters[y * width], smooth ? &smooth[y * width] : nullptr, &out[y * pitch], width);
+            }
+        });
+    }
+
+private:
+    void buildBands() {
+        bands.resize(maxIter + 1);
+        for (int i = 0; i < maxIter; ++i) {
+            double t = (double)i / maxIter + (double)shift / GRADIENT_SIZE;
+            bands[i] = color(t < 1.0 ? t : t - 1.0);
+        }
+        bands[maxIter] = packColor(0, 0, 0);
+    }
+
+    void buildEqualizedBands() {
+        equalizedBands.resize(maxIter + 1);
+        for (int i = 0; i < maxIter; ++i) {
+            int index = std::min((int)levels[i + 1], GRADIENT_SIZE) + shift;
+            equalizedBands[i] = gradientTable[index > GRADIENT_SIZE ? index - GRADIENT_SIZE : index];
+        }
+        equalizedBands[maxIter] = bands[maxIter];
+    }
+
+    Uint32 color(double t) const {
+        int r, g, b;
+        gradient(t, r, g, b);
+        return packColor(std::min(std::max(r, 0), 255), std::min(std::max(g, 0), 255), std::min(std::max(b, 0), 255));
+    }
+
+    GradientFn gradient;
+    std::vector<Uint32> gradientTable;
+    int maxIter = 0;
+    int shift = 0;
+    std::vector<Uint32> bands;
+    std::vector<Uint32> equalizedBands;
+    std::vector<float> levels;
+};
+
+#endif
@@ -0,0 +1,318 @@
+#ifndef PERTURBATION_H
+#define PERTURBATION_H
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include "bigfixed.h"
+#include "escapekernel.h"
+#include "fixedpoint.h"
+#include "precision.h"
+#include "viewport.h"
+
+// Below this pixel size plain doubles can no longer tell neighbouring pixels
+// apart well, and the viewer switches to perturbation.
+const double DEEP_ZOOM_PIXEL_SIZE = 1e-12;
+
+// A view whose centre, at pixel (width / 2, height / 2), is kept in fixed
+// point. Pixel sizes and offsets from the centre stay doubles, which limits
+// zooms to pixel sizes of about 1e-300.
+struct DeepViewport {
+    BigFixed centerRe;
+    BigFixed centerIm;
+    double dre;
+    double dim;
+    int width;
+    int height;
+};
+
+inline int deepViewportLimbs(double dre, double dim) {
+    return BigFixed::limbsFor(dre < dim ? dre : dim);
+}
+
+inline DeepViewport toDeepViewport(const Viewport& view, int width, int height) {
+    int limbs = deepViewportLimbs(view.dre, view.dim);
+    DeepViewport deep = { BigFixed::fromDouble(view.re0, limbs), BigFixed::fromDouble(view.im0, limbs),
+                          view.dre, view.dim, width, height };
+    deep.centerRe = deep.centerRe + BigFixed::fromDouble(width / 2 * view.dre, limbs);
+    deep.centerIm = deep.centerIm + BigFixed::fromDouble(height / 2 * view.dim, limbs);
+    return deep;
+}
+
+inline Viewport toViewport(const DeepViewport& deep) {
+    return { deep.centerRe.toDouble() - deep.width / 2 * deep.dre,
+             deep.centerIm.toDouble() - deep.height / 2 * deep.dim, deep.dre, deep.dim };
+}
+
+// Moves the centre by (offsetRe, offsetIm) and sets new pixel sizes, adding
+// limbs to the centre when the view gets deeper than they resolve.
+inline DeepViewport moveDeepViewport(const DeepViewport& deep, double offsetRe, double offsetIm, double dre, double dim) {
+    int limbs = deepViewportLimbs(dre, dim);
+    if (limbs < deep.centerRe.limbs()) {
+        limbs = deep.centerRe.limbs();
+    }
+    DeepViewport moved = deep;
+    moved.centerRe = deep.centerRe.withLimbs(limbs) + BigFixed::fromDouble(offsetRe, limbs);
+    moved.centerIm = deep.centerIm.withLimbs(limbs) + BigFixed::fromDouble(offsetIm, limbs);
+    moved.dre = dre;
+    moved.dim = dim;
+    return moved;
+}
+
+// Same contract as zoomViewport().
+inline DeepViewport zoomDeepViewport(const DeepViewport& deep, int x, int y, double factor) {
+    double dre = deep.dre * factor;
+    double dim = deep.dim * factor;
+    return moveDeepViewport(deep, (x - deep.width / 2) * (deep.dre - dre), (y - deep.height / 2) * (deep.dim - dim), dre, dim);
+}
+
+// Same contract as panViewport().
+inline DeepViewport panDeepViewport(const DeepViewport& deep, int dx, int dy) {
+    return moveDeepViewport(deep, -dx * deep.dre, -dy * deep.dim, deep.dre, deep.dim);
+}
+
+inline double toDouble(const BigFixed& value) {
+    return value.toDouble();
+}
+
+inline DoubleDouble toDoubleDouble(const BigFixed& value) {
+    double hi = value.toDouble();
+    return DoubleDouble(hi, (value - BigFixed::fromDouble(hi, value.limbs())).toDouble());
+}
+
+// Orbit Z_0 = 0, Z_1, ... of the view centre, computed in Real (FixedPoint,
+// BigFixed or DoubleDouble) and rounded to doubles. It ends at the first
+// escaped value or at Z_maxIter, or early once *cancelled is set.
+struct ReferenceOrbit {
+    std::vector<double> zr;
+    std::vector<double> zi;
+};
+
+template <typename Real>
+ReferenceOrbit computeReferenceOrbit(const Real& cr, const Real& ci, int maxIter,
+                                     const std::atomic<bool>* cancelled = nullptr) {
+    ReferenceOrbit orbit;
+    orbit.zr.push_back(0.0);
+    orbit.zi.push_back(0.0);
+
+    Real zr = cr - cr;
+    Real zi = zr;
+    for (int n = 0; n < maxIter && !(cancelled && cancelled->load(std::memory_order_relaxed)); ++n) {
+        Real zr2 = square(zr);
+        Real zi2 = square(zi);
+        Real zri = zr * zi;
+        zi = zri + zri + ci;
+        zr = zr2 - zi2 + cr;
+
+        double r = toDouble(zr);
+        double i = toDouble(zi);
+        orbit.zr.push_back(r);
+        orbit.zi.push_back(i);
+        if (r * r + i * i > 4.0) {
+            break;
+        }
+    }
+    return orbit;
+}
+
+// Iterates pixel c = C + dc as the double delta dz = z - Z_m against the
+// reference orbit: dz' = (2 Z_m + dz) dz + dc. Where the reference stops
+// being a good approximation (|z| < |dz|, the condition under which
+// perturbation glitches) or runs out, the pixel is rebased: dz becomes the
+// full z and m restarts from Z_0 = 0. Counts match mandelbrot() semantics;
+// the smooth count goes to *smooth if it is given.
+inline int perturbedIterations(const ReferenceOrbit& orbit, double dcr, double dci, int maxIter, EscapeStats& stats,
+                               float* smooth = nullptr) {
+    const double* refR = orbit.zr.data();
+    const double* refI = orbit.zi.data();
+    int last = (int)orbit.zr.size() - 1;
+
+    double dzr = 0.0, dzi = 0.0;
+    double z2 = 0.0;
+    int m = 0;
+    int iter = 0;
+    while (iter < maxIter) {
+        double tr = 2.0 * refR[m] + dzr;
+        double ti = 2.0 * refI[m] + dzi;
+        double nr = tr * dzr - ti * dzi + dcr;
+        double ni = tr * dzi + ti * dzr + dci;
+        dzr = nr;
+        dzi = ni;
+        m++;
+        iter++;
+
+        double zr = refR[m] + dzr;
+        double zi = refI[m] + dzi;
+        z2 = zr * zr + zi * zi;
+        if (z2 > 4.0) {
+            break;
+        }
+        if (z2 < dzr * dzr + dzi * dzi || m == last) {
+            dzr = zr;
+            dzi = zi;
+            m = 0;
+            stats.rebases++;
+        }
+    }
+    stats.iterations += iter;
+    if (smooth) {
+        *smooth = iter < maxIter ? smoothIterations(iter, z2) : (float)maxIter;
+    }
+    return iter;
+}
+
+// The value of a BigFixed, truncated to the fraction bits of a FixedPoint.
+// Every 32-bit limb times its power of two is exactly a double.
+template <int Limbs>
+FixedPoint<Limbs> toFixedPoint(const BigFixed& value) {
+    FixedPoint<Limbs> result;
+    for (int i = 0; i < value.limbs(); ++i) {
+        result = result + FixedPoint<Limbs>(std::ldexp((double)value.limb(i), 32 * (i - value.limbs() + 1)));
+    }
+    return value.isNegative() ? -result : result;
+}
+
+// The orbit in the smallest FixedPoint with as many fraction bits as the
+// centre, or in BigFixed past 1024 bits.
+template <int Limbs, int... More>
+ReferenceOrbit fixedPointOrbit(const BigFixed& centerRe, const BigFixed& centerIm, int maxIter,
+                               const std::atomic<bool>* cancelled) {
+    if (32 * (centerRe.limbs() - 1) <= FixedPoint<Limbs>::FRACTION_BITS) {
+        return computeReferenceOrbit(toFixedPoint<Limbs>(centerRe), toFixedPoint<Limbs>(centerIm), maxIter,
+                                     cancelled);
+    }
+    return fixedPointOrbit<More...>(centerRe, centerIm, maxIter, cancelled);
+}
+
+template <>
+inline ReferenceOrbit fixedPointOrbit<0>(const BigFixed& centerRe, const BigFixed& centerIm, int maxIter,
+                                         const std::atomic<bool>* cancelled) {
+    return computeReferenceOrbit(centerRe, centerIm, maxIter, cancelled);
+}
+
+// Whether double-double resolves pixels of pixelSize around (re, im).
+inline bool doubleDoubleResolves(const BigFixed& re, const BigFixed& im, double pixelSize) {
+    double magnitude = std::max(std::fabs(re.toDouble()), std::fabs(im.toDouble()));
+    return choosePrecision(pixelSize, magnitude) <= PRECISION_DOUBLE_DOUBLE;
+}
+
+// The orbit of (centerRe, centerIm) for pixels of pixelSize around it,
+// computed in double-double where that resolves them, which is many times
+// faster than fixed point, and otherwise in fixed point. It stops early,
+// unfinished, once *cancelled is set.
+inline ReferenceOrbit referenceOrbitFor(const BigFixed& centerRe, const BigFixed& centerIm, double pixelSize,
+                                        int maxIter, const std::atomic<bool>* cancelled = nullptr) {
+    return doubleDoubleResolves(centerRe, centerIm, pixelSize)
+               ? computeReferenceOrbit(toDoubleDouble(centerRe), toDoubleDouble(centerIm), maxIter, cancelled)
+               : fixedPointOrbit<2, 3, 4, 6, 8, 12, 16, 0>(centerRe, centerIm, maxIter, cancelled);
+}
+
+// The centre of a deep view as a reference point, with its orbit once
+// compute() has run. The viewer runs that as a pool task of its own, and
+// cancels it when the view moves somewhere it no longer serves(); later
+// frames it serves share it instead of computing their own.
+class DeepReference {
+public:
+    DeepReference(const DeepViewport& deep, int maxIter)
+        : re(deep.centerRe), im(deep.centerIm), pixelSize(std::min(deep.dre, deep.dim)), maxIter(maxIter),
+          doubleDouble(doubleDoubleResolves(re, im, pixelSize)) {
+    }
+
+    // Computes the orbit, unless cancel() comes first or meanwhile.
+    void compute() {
+        ReferenceOrbit orbit = referenceOrbitFor(re, im, pixelSize, maxIter, &cancelled);
+        if (!cancelled) {
+            result = std::move(orbit);
+            done = true;
+        }
+    }
+
+    void cancel() {
+        cancelled = true;
+    }
+
+    bool ready() const {
+        return done;
+    }
+
+    // Only once ready().
+    const ReferenceOrbit& orbit() const {
+        return result;
+    }
+
+    // The distance from the centre of deep to the reference.
+    void offsetFrom(const DeepViewport& deep, double& offsetRe, double& offsetIm) const {
+        int limbs = std::max(re.limbs(), deep.centerRe.limbs());
+        offsetRe = (re.withLimbs(limbs) - deep.centerRe.withLimbs(limbs)).toDouble();
+        offsetIm = (im.withLimbs(limbs) - deep.centerIm.withLimbs(limbs)).toDouble();
+    }
+
+    // Whether the pixels of deep, capped at cap, can be iterated against this
+    // reference as well as against their own: it must lie in the view, and
+    // its orbit must be precise enough for their size and run to the cap.
+    // A view panned or zoomed within the frame keeps it.
+    bool serves(const DeepViewport& deep, int cap) const {
+        double offsetRe, offsetIm;
+        offsetFrom(deep, offsetRe, offsetIm);
+        bool inView =
+            std::fabs(offsetRe) <= deep.width / 2 * deep.dre && std::fabs(offsetIm) <= deep.height / 2 * deep.dim;
+        double pixels = std::min(deep.dre, deep.dim);
+        bool precise =
+            doubleDoubleResolves(re, im, pixels) || (!doubleDouble && BigFixed::limbsFor(pixels) <= re.limbs());
+        return inView && precise && cap <= maxIter && !cancelled;
+    }
+
+private:
+    BigFixed re;
+    BigFixed im;
+    double pixelSize;
+    int maxIter;
+    bool doubleDouble;
+    std::atomic<bool> cancelled{false};
+    std::atomic<bool> done{false};
+    ReferenceOrbit result;
+};
+
+// Row function for TileRenderer. Pixel offsets are taken from the
+// reference, which lies (offsetRe, offsetIm) from the pixel at (centerX,
+// centerY): nothing for a view's own, which is at its centre.
+struct PerturbationRows {
+    std::shared_ptr<const DeepReference> reference;
+    double offsetRe;
+    double offsetIm;
+    double dre;
+    double dim;
+    int centerX;
+    int centerY;
+    int maxIter;
+
+    void operator()(int y, int x0, int step, int count, int* iters, float* smooth, EscapeStats& stats) const {
+        const ReferenceOrbit& orbit = reference->orbit();
+        double dci = (y - centerY) * dim - offsetIm;
+        for (int k = 0; k < count; ++k) {
+            double dcr = (x0 + k * step - centerX) * dre - offsetRe;
+            iters[k] = perturbedIterations(orbit, dcr, dci, maxIter, stats, smooth ? &smooth[k] : nullptr);
+        }
+    }
+};
+
+// Rows of deep against reference, which need not be its own but must be
+// ready().
+inline PerturbationRows makePerturbationRows(const std::shared_ptr<const DeepReference>& reference,
+                                             const DeepViewport& deep, int maxIter) {
+    PerturbationRows rows = { reference, 0.0, 0.0, deep.dre, deep.dim, deep.width / 2, deep.height / 2, maxIter };
+    reference->offsetFrom(deep, rows.offsetRe, rows.offsetIm);
+    return rows;
+}
+
+// Rows of deep against its own reference, computed first.
+inline PerturbationRows makePerturbationRows(const DeepViewport& deep, int maxIter) {
+    std::shared_ptr<DeepReference> reference = std::make_shared<DeepReference>(deep, maxIter);
+    reference->compute();
+    return makePerturbationRows(reference, deep, maxIter);
+}
+
+#endif
@@ -0,0 +1,228 @@
+#ifndef POSTER_H
+#define POSTER_H
+
+#include <SDL.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "escapekernel.h"
+#include "mappedfile.h"
+#include "palette.h"
+#include "threadpool.h"
+#include "tilerenderer.h"
+
+// Pixels and iterations of the tiles a Poster computed in one call.
+struct PosterStats {
+    long long tiles = 0;
+    long long pixels = 0;
+    long long iterations = 0;
+};
+
+// An image too large for memory, kept in a file of POSTER_TILE x POSTER_TILE
+// tiles of colors. Each tile is stored contiguously, so writing one touches
+// only its own pages, and the file is mapped, so only the pages being written
+// or read take memory: the system writes finished ones back and drops them.
+//
+// A sidecar file, path + ".done", has a byte per tile set once the tile is
+// on disk. Rendering skips the tiles marked there, so a render that was
+// killed, or stopped by a crash, picks up where it left off. The header
+// holds a fingerprint of what is rendered, and a file made for something
+// else is not reopened.
+class Poster {
+public:
+    static constexpr int POSTER_TILE = 256;
+
+    // Opens path for a width x height image, creating it and its sidecar if
+    // needed. Fails if the file exists with another size or fingerprint, or
+    // holds something other than a poster. A new poster starts with every
+    // tile unmarked, whatever a sidecar left behind says.
+    bool open(const std::string& path, int width, int height, uint64_t fingerprint) {
+        if (isForeignFile(path, MAGIC)) {
+            return false;
+        }
+        int across = (width + POSTER_TILE - 1) / POSTER_TILE;
+        int down = (height + POSTER_TILE - 1) / POSTER_TILE;
+        size_t size = sizeof(Header) + (size_t)across * down * tileBytes();
+        if (!pixels.open(path, size)) {
+            return false;
+        }
+        // A new poster's sidecar is cleared before its magic is written, so
+        // a header is never valid next to stale marks.
+        Header* header = (Header*)pixels.data();
+        bool fresh = header->magic != MAGIC;
+        if (fresh) {
+            header->width = width;
+            header->height = height;
+            header->tileSize = POSTER_TILE;
+            header->fingerprint = fingerprint;
+            if (!openIndex(path)) {
+                return false;
+            }
+            std::memset(index.data(), 0, index.size());
+            index.flush(true);
+            header->magic = MAGIC;
+            pixels.flush(true);
+        }
+        if (header->width != width || header->height != height || header->tileSize != POSTER_TILE ||
+            header->fingerprint != fingerprint) {
+            pixels.close();
+            return false;
+        }
+        return fresh || openIndex(path);
+    }
+
+    // Opens an existing poster as it is, to read it. Mapping would create a
+    // missing file and grow a short one, so those, and files holding
+    // something else, are turned down before it.
+    bool open(const std::string& path) {
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file || (size_t)file.tellg() < sizeof(Header) || isForeignFile(path, MAGIC)) {
+            return false;
+        }
+        file.close();
+        if (!pixels.open(path, sizeof(Header))) {
+            return false;
+        }
+        const Header* header = (const Header*)pixels.data();
+        if (header->magic != MAGIC || header->tileSize != POSTER_TILE ||
+            pixels.size() < sizeof(Header) + (size_t)tilesAcross() * tilesDown() * tileBytes()) {
+            pixels.close();
+            return false;
+        }
+        return openIndex(path);
+    }
+
+    int width() const {
+        return ((const Header*)pixels.data())->width;
+    }
+
+    int height() const {
+        return ((const Header*)pixels.data())->height;
+    }
+
+    int tilesAcross() const {
+        return (width() + POSTER_TILE - 1) / POSTER_TILE;
+    }
+
+    int tilesDown() const {
+        return (height() + POSTER_TILE - 1) / POSTER_TILE;
+    }
+
+    int tilesDone() const {
+        return (int)std::count(index.data(), index.data() + tilesAcross() * tilesDown(), 1);
+    }
+
+    // Computes and colors the tiles not marked done, a row of tiles at a
+    // time: their pixels are written to disk before they are marked, so a
+    // tile marked done is never half written. rows gives iteration counts
+    // as for TileRenderer; smooth counts are asked for unless mode is
+    // COLOR_BANDED. progress is called after every row of tiles.
+    PosterStats render(ThreadPool& pool, const RowFunction& rows, const Palette& palette, ColorMode mode,
+                       const std::function<void(int tileRow, const PosterStats& stats)>& progress) {
+        PosterStats total;
+        int across = tilesAcross();
+        unsigned char* done = index.data();
+        for (int ty = 0; ty < tilesDown(); ++ty) {
+            std::vector<int> pending;
+            for (int tx = 0; tx < across; ++tx) {
+                if (!done[ty * across + tx]) {
+                    pending.push_back(ty * across + tx);
+                }
+            }
+            if (pending.empty()) {
+                continue;
+            }
+            std::vector<PosterStats> slotStats(pool.size() + 1);
+            pool.parallelFor((int)pending.size(), [&](int i, int slot) {
+                renderTile(rows, palette, mode, pending[i], slotStats[slot]);
+            });
+            pixels.flush(true);
+            for (int tile : pending) {
+                done[tile] = 1;
+            }
+            index.flush(true);
+            for (const PosterStats& slot : slotStats) {
+                total.tiles += slot.tiles;
+                total.pixels += slot.pixels;
+                total.iterations += slot.iterations;
+            }
+            progress(ty, total);
+        }
+        return total;
+    }
+
+    // Copies rows y0 .. y0 + count - 1 of the image into out, pitch pixels
+    // between rows.
+    void readRows(int y0, int count, Uint32* out, int pitch) const {
+        for (int y = y0; y < y0 + count; ++y) {
+            for (int tx = 0; tx < tilesAcross(); ++tx) {
+                int x0 = tx * POSTER_TILE;
+                int columns = std::min(POSTER_TILE, width() - x0);
+                const Uint32* tile = tileAt((y / POSTER_TILE) * tilesAcross() + tx);
+                std::memcpy(&out[(y - y0) * pitch + x0], &tile[(y % POSTER_TILE) * POSTER_TILE],
+                            columns * sizeof(Uint32));
+            }
+        }
+    }
+
+private:
+    static const uint32_t MAGIC = 0x31545350; // "PST1"
+
+    struct Header {
+        uint32_t magic;
+        int32_t width;
+        int32_t height;
+        int32_t tileSize;
+        uint64_t fingerprint;
+    };
+
+    static size_t tileBytes() {
+        return (size_t)POSTER_TILE * POSTER_TILE * sizeof(Uint32);
+    }
+
+    bool openIndex(const std::string& path) {
+        if (!index.open(path + ".done", (size_t)tilesAcross() * tilesDown())) {
+            pixels.close();
+            return false;
+        }
+        return true;
+    }
+
+    Uint32* tileAt(int tile) {
+        return (Uint32*)(pixels.data() + sizeof(Header) + tile * tileBytes());
+    }
+
+    const Uint32* tileAt(int tile) const {
+        return (const Uint32*)(pixels.data() + sizeof(Header) + tile * tileBytes());
+    }
+
+    void renderTile(const RowFunction& rows, const Palette& palette, ColorMode mode, int tile,
+                    PosterStats& stats) {
+        int x0 = tile % tilesAcross() * POSTER_TILE;
+        int y0 = tile / tilesAcross() * POSTER_TILE;
+        int columns = std::min(POSTER_TILE, width() - x0);
+        int lines = std::min(POSTER_TILE, height() - y0);
+        int iters[POSTER_TILE];
+        float smooth[POSTER_TILE];
+        float* smoothOut = mode == COLOR_BANDED ? nullptr : smooth;
+        Uint32* out = tileAt(tile);
+        EscapeStats escape;
+        for (int y = 0; y < lines; ++y) {
+            rows(y0 + y, x0, 1, columns, iters, smoothOut, escape);
+            palette.colorRow(mode, iters, smoothOut, &out[y * POSTER_TILE], columns);
+        }
+        stats.tiles++;
+        stats.pixels += (long long)columns * lines;
+        stats.iterations += escape.iterations;
+    }
+
+    MappedFile pixels;
+    MappedFile index;
+};
+
+#endif
@@ -0,0 +1,128 @@
+#ifndef PRECISION_H
+#define PRECISION_H
+
+#include <algorithm>
+#include <cmath>
+
+// A number kept as the unevaluated sum hi + lo of two doubles, |lo| <= half
+// an ulp of hi, which gives about 106 bits of mantissa. Sums and products
+// use the error-free transformations (Knuth's two-sum, Dekker's two-product
+// by splitting), so they do not need an FMA instruction.
+struct DoubleDouble {
+    double hi;
+    double lo;
+
+    DoubleDouble(double value = 0.0) : hi(value), lo(0.0) {
+    }
+
+    DoubleDouble(double hi, double lo) : hi(hi), lo(lo) {
+    }
+
+    static DoubleDouble twoSum(double a, double b) {
+        double s = a + b;
+        double v = s - a;
+        return DoubleDouble(s, (a - (s - v)) + (b - v));
+    }
+
+    static DoubleDouble quickTwoSum(double a, double b) {
+        double s = a + b;
+        return DoubleDouble(s, b - (s - a));
+    }
+
+    static DoubleDouble twoProduct(double a, double b) {
+        const double SPLIT = 134217729.0; // 2^27 + 1
+        double p = a * b;
+        double ta = SPLIT * a;
+        double ah = ta - (ta - a);
+        double al = a - ah;
+        double tb = SPLIT * b;
+        double bh = tb - (tb - b);
+        double bl = b - bh;
+        return DoubleDouble(p, ((ah * bh - p) + ah * bl + al * bh) + al * bl);
+    }
+
+    DoubleDouble operator-() const {
+        return DoubleDouble(-hi, -lo);
+    }
+
+    DoubleDouble operator+(const DoubleDouble& other) const {
+        DoubleDouble s = twoSum(hi, other.hi);
+        DoubleDouble t = twoSum(lo, other.lo);
+        s = quickTwoSum(s.hi, s.lo + t.hi);
+        return quickTwoSum(s.hi, s.lo + t.lo);
+    }
+
+    DoubleDouble operator-(const DoubleDouble& other) const {
+        return *this + (-other);
+    }
+
+    DoubleDouble operator*(const DoubleDouble& other) const {
+        DoubleDouble p = twoProduct(hi, other.hi);
+        return quickTwoSum(p.hi, p.lo + (hi * other.lo + lo * other.hi));
+    }
+
+    bool operator>(double value) const {
+        return hi > value || (hi == value && lo > 0.0);
+    }
+};
+
+inline double toDouble(float value) {
+    return value;
+}
+
+inline double toDouble(double value) {
+    return value;
+}
+
+inline double toDouble(const DoubleDouble& value) {
+    return value.hi + value.lo;
+}
+
+// x * x, which some number types compute faster than a product.
+inline float square(float value) {
+    return value * value;
+}
+
+inline double square(double value) {
+    return value * value;
+}
+
+inline DoubleDouble square(const DoubleDouble& value) {
+    DoubleDouble p = DoubleDouble::twoProduct(value.hi, value.hi);
+    return DoubleDouble::quickTwoSum(p.hi, p.lo + 2.0 * value.hi * value.lo);
+}
+
+// Numeric types the escape-time loop can run in, cheapest first.
+enum Precision { PRECISION_FLOAT, PRECISION_DOUBLE, PRECISION_DOUBLE_DOUBLE, PRECISION_FIXED };
+
+inline const char* precisionName(Precision precision) {
+    switch (precision) {
+        case PRECISION_FLOAT: return "float";
+        case PRECISION_DOUBLE: return "double";
+        case PRECISION_DOUBLE_DOUBLE: return "double-double";
+        default: return "fixed point";
+    }
+}
+
+// The cheapest precision that still resolves pixels of pixelSize around
+// points of the given magnitude: one whose spacing between representable
+// numbers there is at most 1/PRECISION_MARGIN of a pixel. Below that,
+// rounding starts to show as noise and blocky pixels, because the orbit
+// amplifies the error in c.
+const double PRECISION_MARGIN = 1024.0;
+
+inline Precision choosePrecision(double pixelSize, double magnitude) {
+    double scale = std::max(magnitude, 1.0) * PRECISION_MARGIN;
+    if (pixelSize >= std::ldexp(scale, -23)) {
+        return PRECISION_FLOAT;
+    }
+    if (pixelSize >= std::ldexp(scale, -52)) {
+        return PRECISION_DOUBLE;
+    }
+    if (pixelSize >= std::ldexp(scale, -104)) {
+        return PRECISION_DOUBLE_DOUBLE;
+    }
+    return PRECISION_FIXED;
+}
+
+#endif
@@ -0,0 +1,255 @@
+#ifndef RENDERFARM_H
+#define RENDERFARM_H
+
+#ifndef _WIN32
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <new>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "tilerenderer.h"
+
+// Tiles and iterations a RenderFarm computed, the workers that died while
+// computing, and the tiles handed out again because of them.
+struct FarmStats {
+    long long tiles = 0;
+    long long iterations = 0;
+    int crashes = 0;
+    int reassigned = 0;
+};
+
+// Computes the iteration counts of a width x height frame in worker
+// processes, so a worker that crashes takes only its tile with it.
+//
+// Everything the workers share lives in one POSIX shared memory segment: a
+// queue of tile numbers, the owner of every tile, and the iteration and
+// smooth counts of the frame, which the workers write directly. The queue is
+// an array with a head and a tail index; workers claim entries by advancing
+// the head with a compare-and-swap, and only the coordinator appends, so no
+// locks are needed and none can be left held by a dead worker. A worker
+// marks a tile with its pid while it computes it and as done once written.
+//
+// The coordinator forks the workers and waits for them. When one dies, the
+// tiles it held go back on the queue and a new worker is forked. Once all
+// have exited, any tile not marked done, such as one claimed by a worker
+// killed before it could mark it, is queued again. A tile that brought down
+// FARM_ATTEMPTS workers fails the render instead of crashing workers forever.
+//
+// Workers are forked from the calling thread and inherit only it, so the
+// caller must not have other threads, such as a ThreadPool, while render()
+// runs. Not available on Windows, which has no fork().
+class RenderFarm {
+public:
+    static constexpr int FARM_TILE = 64;
+    static const int FARM_ATTEMPTS = 3;
+
+    RenderFarm(int width, int height, bool smooth)
+        : width(width), height(height), across((width + FARM_TILE - 1) / FARM_TILE),
+          tiles(across * ((height + FARM_TILE - 1) / FARM_TILE)), smooth(smooth) {
+    }
+
+    ~RenderFarm() {
+        if (base) {
+            munmap(base, bytes);
+        }
+    }
+
+    RenderFarm(const RenderFarm&) = delete;
+    RenderFarm& operator=(const RenderFarm&) = delete;
+
+    // Computes the frame from rows with workers processes. Returns false if
+    // the shared memory or the workers could not be set up, or a tile kept
+    // crashing its workers.
+    bool render(const RowFunction& rows, int workers, FarmStats& stats) {
+        if (!map()) {
+            return false;
+        }
+        std::vector<int> attempts(tiles, 0);
+        bool failed = false;
+        for (int tile = 0; tile < tiles; ++tile) {
+            enqueue(tile, attempts);
+        }
+        int live = spawn(rows, std::min(workers, tiles));
+        while (live > 0) {
+            int status;
+            pid_t pid = waitpid(-1, &status, 0);
+            if (pid < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                break;
+            }
+            live--;
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                stats.crashes++;
+                for (int tile = 0; tile < tiles; ++tile) {
+                    int held = pid;
+                    if (owner[tile].compare_exchange_strong(held, QUEUED)) {
+                        failed |= !enqueue(tile, attempts);
+                        stats.reassigned++;
+                    }
+                }
+                if (!failed && shared->head.load() < shared->tail.load()) {
+                    live += spawn(rows, 1);
+                }
+            }
+            if (live == 0 && !failed && shared->head.load() >= shared->tail.load()) {
+                for (int tile = 0; tile < tiles; ++tile) {
+                    if (owner[tile].load() != DONE) {
+                        stats.reassigned++;
+                        failed |= !enqueue(tile, attempts);
+                    }
+                }
+                if (!failed && shared->head.load() < shared->tail.load()) {
+                    live += spawn(rows, std::min(workers, shared->tail.load() - shared->head.load()));
+                }
+            }
+        }
+        stats.tiles += tiles;
+        stats.iterations += shared->iterations.load();
+        for (int tile = 0; tile < tiles; ++tile) {
+            failed |= owner[tile].load() != DONE;
+        }
+        return !failed;
+    }
+
+    const int* iterations() const {
+        return iters;
+    }
+
+    // Null unless the farm was made with smooth set.
+    const float* smoothIterations() const {
+        return smooth ? smoothIters : nullptr;
+    }
+
+private:
+    static const int QUEUED = 0;
+    static const int DONE = -1;
+
+    static_assert(std::atomic<int>::is_always_lock_free && std::atomic<long long>::is_always_lock_free,
+                  "the farm's queue needs atomics that work across processes");
+
+    struct Shared {
+        std::atomic<int> head;
+        std::atomic<int> tail;
+        std::atomic<long long> iterations;
+    };
+
+    static size_t aligned(size_t offset) {
+        return (offset + 63) & ~(size_t)63;
+    }
+
+    // Creates the shared segment and unlinks its name at once, so nothing is
+    // left behind however the process ends; the mapping is all the workers
+    // need, and they inherit it.
+    bool map() {
+        if (base) {
+            return true;
+        }
+        size_t queueAt = aligned(sizeof(Shared));
+        size_t ownerAt = aligned(queueAt + sizeof(int) * tiles * FARM_ATTEMPTS);
+        size_t itersAt = aligned(ownerAt + sizeof(std::atomic<int>) * tiles);
+        size_t smoothAt = aligned(itersAt + sizeof(int) * width * height);
+        bytes = smoothAt + (smooth ? sizeof(float) * width * height : 0);
+        std::string name = "/mandelbrot-farm-" + std::to_string(getpid());
+        int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd < 0) {
+            return false;
+        }
+        shm_unlink(name.c_str());
+        void* mapped = ftruncate(fd, (off_t)bytes) == 0
+                           ? mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+                           : MAP_FAILED;
+        close(fd);
+        if (mapped == MAP_FAILED) {
+            return false;
+        }
+        base = (unsigned char*)mapped;
+        shared = new (base) Shared{ { 0 }, { 0 }, { 0 } };
+        queue = (int*)(base + queueAt);
+        owner = (std::atomic<int>*)(base + ownerAt);
+        for (int tile = 0; tile < tiles; ++tile) {
+            new (&owner[tile]) std::atomic<int>(QUEUED);
+        }
+        iters = (int*)(base + itersAt);
+        smoothIters = (float*)(base + smoothAt);
+        return true;
+    }
+
+    // Appends tile to the queue, unless it has been queued FARM_ATTEMPTS
+    // times already.
+    bool enqueue(int tile, std::vector<int>& attempts) {
+        if (attempts[tile] == FARM_ATTEMPTS) {
+            return false;
+        }
+        attempts[tile]++;
+        int tail = shared->tail.load(std::memory_order_relaxed);
+        queue[tail] = tile;
+        shared->tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Forks count workers and returns how many started.
+    int spawn(const RowFunction& rows, int count) {
+        int started = 0;
+        for (int i = 0; i < count; ++i) {
+            pid_t pid = fork();
+            if (pid == 0) {
+                work(rows);
+                _exit(0);
+            }
+            started += pid > 0 ? 1 : 0;
+        }
+        return started;
+    }
+
+    // A worker's loop: claims tiles until the queue is empty.
+    void work(const RowFunction& rows) {
+        int self = (int)getpid();
+        for (;;) {
+            int entry = shared->head.load(std::memory_order_acquire);
+            do {
+                if (entry >= shared->tail.load(std::memory_order_acquire)) {
+                    return;
+                }
+            } while (!shared->head.compare_exchange_weak(entry, entry + 1, std::memory_order_acq_rel));
+            int tile = queue[entry];
+            owner[tile].store(self, std::memory_order_release);
+            int x0 = tile % across * FARM_TILE;
+            int y0 = tile / across * FARM_TILE;
+            int columns = std::min(FARM_TILE, width - x0);
+            int lines = std::min(FARM_TILE, height - y0);
+            EscapeStats escape;
+            for (int y = y0; y < y0 + lines; ++y) {
+                int offset = y * width + x0;
+                rows(y, x0, 1, columns, &iters[offset], smooth ? &smoothIters[offset] : nullptr, escape);
+            }
+            shared->iterations.fetch_add(escape.iterations, std::memory_order_relaxed);
+            owner[tile].store(DONE, std::memory_order_release);
+        }
+    }
+
+    int width;
+    int height;
+    int across;
+    int tiles;
+    bool smooth;
+    unsigned char* base = nullptr;
+    size_t bytes = 0;
+    Shared* shared = nullptr;
+    int* queue = nullptr;
+    std::atomic<int>* owner = nullptr;
+    int* iters = nullptr;
+    float* smoothIters = nullptr;
+};
+
+#endif
+
+#endif
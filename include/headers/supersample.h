@@ -0,0 +1,290 @@
+#ifndef SUPERSAMPLE_H
+#define SUPERSAMPLE_H
+
+#include <SDL.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "escapekernel.h"
+#include "formula.h"
+#include "framebuffer.h"
+#include "palette.h"
+#include "threadpool.h"
+#include "viewport.h"
+
+// A uniform value in [0, 1) from a hash of (y, salt), for sample offsets that
+// are random but the same in every run.
+inline double jitter(int y, int salt) {
+    Uint32 h = (Uint32)y * 0x85EBCA77u ^ (Uint32)salt * 0xC2B2AE3Du;
+    h ^= h >> 15;
+    h *= 0x2C1B3C6Du;
+    h ^= h >> 12;
+    h *= 0x297A2D39u;
+    h ^= h >> 15;
+    return (h >> 8) * (1.0 / 16777216.0);
+}
+
+// Pixels given more samples by a Supersampler, the samples that took and
+// their iterations.
+struct SupersampleStats {
+    long long pixels = 0;
+    long long samples = 0;
+    long long iterations = 0;
+};
+
+// Adaptive anti-aliasing of a finished frame. Every pixel already has one
+// sample, at its point of the view. A pixel is resampled with grid x grid
+// subsamples only if
+//
+//   - the count of one of its eight neighbours differs from its own by more
+//     than countThreshold (smooth counts when the frame has them), or
+//   - it escaped and its distance estimate is under distancePixels pixels,
+//     which finds filaments too thin to show up in any of the counts,
+//
+// and gets the mean color of its subsamples. Resampling every pixel with all
+// of its subsamples instead (setAdaptive(false)) is plain uniform
+// supersampling.
+//
+// Subsamples are stratified with jitter: the j-th row of the grid sits at a
+// random height in the j-th strip of the pixel, and its samples are evenly
+// spaced from a random offset. Neighbouring pixels that are both resampled
+// share their rows, which keeps the rows long enough to fill the kernels'
+// lanes. The offsets are hashed from the pixel position, so frames are
+// reproducible.
+class Supersampler {
+public:
+    static const int DEFAULT_GRID = 4;
+
+    Supersampler(ThreadPool& pool, EscapeSpanFn span, Formula formula = FORMULA_MANDELBROT)
+        : pool(pool), span(span), distance(distanceEstimateFor(formula)) {
+    }
+
+    // The kernel for the subsamples, normally the one the frame was computed
+    // with so they agree with its first samples.
+    void setKernel(EscapeSpanFn kernel) {
+        span = kernel;
+    }
+
+    void setSeed(double re, double im) {
+        seedRe = re;
+        seedIm = im;
+    }
+
+    void setGrid(int size) {
+        grid = std::max(size, 1);
+    }
+
+    void setThresholds(float counts, double pixels) {
+        countThreshold = counts;
+        distancePixels = pixels;
+    }
+
+    void setAdaptive(bool enabled) {
+        adaptive = enabled;
+    }
+
+    // Resamples the pixels of a width x height frame that need it, given the
+    // counts it was colored from, and overwrites their colors in out (pitch
+    // pixels between rows). The palette must be set up for maxIter.
+    SupersampleStats apply(const Viewport& view, int maxIter, const Palette& palette, ColorMode mode, const int* iters,
+                           const float* smooth, int width, int height, Uint32* out, int pitch) {
+        return applyRows(view, maxIter, palette, mode, iters, smooth, width, height, 0, height, out, pitch);
+    }
+
+    // apply() for rows first .. first + count - 1 of the frame only, so a
+    // caller can do the frame a band at a time and handle input in between.
+    SupersampleStats applyRows(const Viewport& view, int maxIter, const Palette& palette, ColorMode mode,
+                               const int* iters, const float* smooth, int width, int height, int first, int count,
+                               Uint32* out, int pitch) {
+        const int ROWS_PER_CHUNK = 8;
+        int last = std::min(height, first + count);
+        std::vector<SupersampleStats> slotStats(pool.size() + 1);
+        pool.parallelFor((last - first + ROWS_PER_CHUNK - 1) / ROWS_PER_CHUNK, [&](int chunk, int slot) {
+            Scratch scratch;
+            std::vector<char> marked(width);
+            int end = std::min(last, first + (chunk + 1) * ROWS_PER_CHUNK);
+            for (int y = first + chunk * ROWS_PER_CHUNK; y < end; ++y) {
+                if (adaptive) {
+                    markRow(view, maxIter, iters, smooth, width, height, y, marked.data());
+                } else {
+                    std::fill(marked.begin(), marked.end(), 1);
+                }
+                for (int x = 0; x < width;) {
+                    if (!marked[x]) {
+                        ++x;
+                        continue;
+                    }
+                    int runEnd = x;
+                    while (runEnd < width && runEnd - x < MAX_RUN && marked[runEnd]) {
+                        ++runEnd;
+                    }
+                    sampleRun(view, maxIter, palette, mode, x, runEnd - x, y, scratch, &out[y * pitch + x],
+                              slotStats[slot]);
+                    x = runEnd;
+                }
+            }
+        });
+        SupersampleStats stats;
+        for (const SupersampleStats& slot : slotStats) {
+            stats.pixels += slot.pixels;
+            stats.samples += slot.samples;
+            stats.iterations += slot.iterations;
+        }
+        return stats;
+    }
+
+private:
+    // Longest run of neighbouring pixels that share subsample rows.
+    static const int MAX_RUN = 64;
+
+    // Largest difference in any channel between the colors of one pixel's
+    // samples that still counts as a single color.
+    static const int COLOR_TOLERANCE = 6;
+
+    // Sum of a pixel's subsample colors, and the range of every channel over
+    // them and the pixel's first sample.
+    struct PixelSum {
+        int sum[3] = { 0, 0, 0 };
+        int low[3] = { 255, 255, 255 };
+        int high[3] = { 0, 0, 0 };
+        int samples = 0;
+
+        void include(Uint32 color, bool counted) {
+            for (int c = 0; c < 3; ++c) {
+                int value = (color >> (16 - 8 * c)) & 0xFF;
+                low[c] = std::min(low[c], value);
+                high[c] = std::max(high[c], value);
+                sum[c] += counted ? value : 0;
+            }
+            samples += counted;
+        }
+
+        bool varies() const {
+            return high[0] - low[0] > COLOR_TOLERANCE || high[1] - low[1] > COLOR_TOLERANCE ||
+                   high[2] - low[2] > COLOR_TOLERANCE;
+        }
+
+        Uint32 mean() const {
+            return packColor((sum[0] + samples / 2) / samples, (sum[1] + samples / 2) / samples,
+                             (sum[2] + samples / 2) / samples);
+        }
+    };
+
+    struct Scratch {
+        std::vector<int> iters;
+        std::vector<float> smooth;
+        std::vector<Uint32> colors;
+        std::vector<PixelSum> pixels;
+    };
+
+    // Marks the pixels of row y that need more samples. The counts are
+    // compared one neighbour direction at a time over the whole row, which
+    // the compiler vectorizes; only escaped pixels left unmarked then get a
+    // distance estimate.
+    void markRow(const Viewport& view, int maxIter, const int* iters, const float* smooth, int width, int height, int y,
+                 char* marked) const {
+        std::fill(marked, marked + width, 0);
+        const int* count = &iters[y * width];
+        for (int ny = std::max(y - 1, 0); ny <= std::min(y + 1, height - 1); ++ny) {
+            for (int dx = -1; dx <= 1; ++dx) {
+                if (ny == y && dx == 0) {
+                    continue;
+                }
+                int from = std::max(-dx, 0), to = std::min(width, width - dx);
+                const int* other = &iters[ny * width];
+                if (smooth) {
+                    const float* value = &smooth[y * width];
+                    const float* otherValue = &smooth[ny * width];
+                    for (int x = from; x < to; ++x) {
+                        marked[x] |= (std::fabs(otherValue[x + dx] - value[x]) > countThreshold) |
+                                     ((count[x] == maxIter) != (other[x + dx] == maxIter));
+                    }
+                } else {
+                    for (int x = from; x < to; ++x) {
+                        marked[x] |= std::abs(other[x + dx] - count[x]) > countThreshold;
+                    }
+                }
+            }
+        }
+        if (distancePixels <= 0.0) {
+            return;
+        }
+        double limit = distancePixels * std::max(std::fabs(view.dre), std::fabs(view.dim));
+        for (int x = 0; x < width; ++x) {
+            if (!marked[x] && count[x] < maxIter) {
+                std::complex<double> c = pixelToComplex(view, x, y);
+                double estimate = distance(c.real(), c.imag(), seedRe, seedIm, maxIter);
+                marked[x] = estimate >= 0.0 && estimate < limit;
+            }
+        }
+    }
+
+    // Resamples the pixels x .. x + count - 1 of row y into out, in two
+    // passes: the even rows of the grid first, then the odd rows only for
+    // pixels whose samples so far, and their first sample, differ by more
+    // than COLOR_TOLERANCE in some channel. Pixels that only sit next to a
+    // change in the counts are usually one color under smooth coloring, and
+    // stop at half the samples.
+    void sampleRun(const Viewport& view, int maxIter, const Palette& palette, ColorMode mode, int x, int count, int y,
+                   Scratch& scratch, Uint32* out, SupersampleStats& stats) const {
+        scratch.pixels.assign(count, PixelSum());
+        for (int i = 0; i < count; ++i) {
+            scratch.pixels[i].include(out[i], false);
+        }
+        sampleRows(view, maxIter, palette, mode, x, count, y, 0, scratch, &scratch.pixels[0], stats);
+        for (int i = 0; i < count;) {
+            if (adaptive && !scratch.pixels[i].varies()) {
+                ++i;
+                continue;
+            }
+            int end = i;
+            while (end < count && (!adaptive || scratch.pixels[end].varies())) {
+                ++end;
+            }
+            sampleRows(view, maxIter, palette, mode, x + i, end - i, y, 1, scratch, &scratch.pixels[i], stats);
+            i = end;
+        }
+        for (int i = 0; i < count; ++i) {
+            out[i] = scratch.pixels[i].mean();
+        }
+        stats.pixels += count;
+    }
+
+    // Computes the rows first, first + 2, ... of the grid for count pixels
+    // from x and adds each sample's color to its pixel.
+    void sampleRows(const Viewport& view, int maxIter, const Palette& palette, ColorMode mode, int x, int count, int y,
+                    int first, Scratch& scratch, PixelSum* pixels, SupersampleStats& stats) const {
+        int samples = count * grid;
+        scratch.iters.resize(samples);
+        scratch.smooth.resize(samples);
+        scratch.colors.resize(samples);
+        float* smoothOut = mode == COLOR_BANDED ? nullptr : scratch.smooth.data();
+        EscapeStats escape;
+        for (int j = first; j < grid; j += 2) {
+            double dy = (j + jitter(y, 2 * j)) / grid - 0.5;
+            double dx = jitter(y, 2 * j + 1) / grid - 0.5;
+            EscapeRow row = { view.re0 + (x + dx) * view.dre, view.dre / grid, view.im0 + (y + dy) * view.dim, 0, 1,
+                              samples, maxIter, true, scratch.iters.data(), smoothOut, nullptr, seedRe, seedIm };
+            span(row, escape);
+            palette.colorRow(mode, scratch.iters.data(), smoothOut, scratch.colors.data(), samples);
+            for (int k = 0; k < samples; ++k) {
+                pixels[k / grid].include(scratch.colors[k], true);
+            }
+            stats.samples += samples;
+        }
+        stats.iterations += escape.iterations;
+    }
+
+    ThreadPool& pool;
+    EscapeSpanFn span;
+    DistanceEstimateFn distance;
+    double seedRe = 0.0;
+    double seedIm = 0.0;
+    int grid = DEFAULT_GRID;
+    float countThreshold = 1.0f;
+    double distancePixels = 1.0;
+    bool adaptive = true;
+};
+
+#endif
@@ -0,0 +1,188 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <SDL.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing thread pool. Every worker owns a deque: it takes its own work
+// from the back and, when that runs dry, steals from the front of the others.
+// Tasks submitted from inside a worker go to that worker's deque, so recursive
+// jobs stay local until someone else is idle.
+class ThreadPool {
+public:
+    explicit ThreadPool(int threads = 0) {
+        if (threads <= 0) {
+            threads = SDL_GetCPUCount();
+        }
+        if (threads <= 0) {
+            threads = 1;
+        }
+        for (int i = 0; i < threads; ++i) {
+            queues.emplace_back(new Queue());
+        }
+        for (int i = 0; i < threads; ++i) {
+            workers.emplace_back(&ThreadPool::workerLoop, this, i);
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    int size() const {
+        return (int)workers.size();
+    }
+
+    void submit(std::function<void()> task) {
+        int index = currentWorker().pool == this ? currentWorker().index
+                                                 : (int)(nextQueue++ % queues.size());
+        pending++;
+        {
+            std::lock_guard<std::mutex> lock(queues[index]->mutex);
+            queues[index]->tasks.push_back(std::move(task));
+        }
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            queued++;
+        }
+        wake.notify_one();
+    }
+
+    // Blocks until every task submitted so far has finished.
+    void wait() {
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        idle.wait(lock, [this] { return pending.load() == 0; });
+    }
+
+    // Calls body(index, slot) for every index in [0, count) and returns when
+    // all calls are done. The calling thread takes indices as well, so this
+    // finishes even while the workers are busy with other tasks. slot is in
+    // [0, size()] and no two concurrent calls share one, so it can pick
+    // per-thread scratch space.
+    void parallelFor(int count, std::function<void(int index, int slot)> body) {
+        struct Shared {
+            std::function<void(int, int)> body;
+            int count;
+            std::atomic<int> next{0};
+            std::atomic<int> done{0};
+            std::mutex mutex;
+            std::condition_variable finished;
+        };
+        std::shared_ptr<Shared> shared = std::make_shared<Shared>();
+        shared->body = std::move(body);
+        shared->count = count;
+
+        auto drain = [](Shared& shared, int slot) {
+            int index;
+            while ((index = shared.next++) < shared.count) {
+                shared.body(index, slot);
+                if (++shared.done == shared.count) {
+                    std::lock_guard<std::mutex> lock(shared.mutex);
+                    shared.finished.notify_all();
+                }
+            }
+        };
+        int helpers = std::min(size(), count - 1);
+        for (int i = 0; i < helpers; ++i) {
+            submit([shared, drain, i] { drain(*shared, i + 1); });
+        }
+        drain(*shared, 0);
+        std::unique_lock<std::mutex> lock(shared->mutex);
+        shared->finished.wait(lock, [&] { return shared->done.load() == shared->count; });
+    }
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    struct WorkerId {
+        ThreadPool* pool;
+        int index;
+    };
+
+    static WorkerId& currentWorker() {
+        static thread_local WorkerId id = { nullptr, -1 };
+        return id;
+    }
+
+    bool popTask(int self, std::function<void()>& task) {
+        {
+            Queue& own = *queues[self];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty()) {
+                task = std::move(own.tasks.back());
+                own.tasks.pop_back();
+                return true;
+            }
+        }
+        for (size_t i = 1; i < queues.size(); ++i) {
+            Queue& victim = *queues[(self + i) % queues.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void workerLoop(int index) {
+        currentWorker() = { this, index };
+        std::function<void()> task;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(sleepMutex);
+                wake.wait(lock, [this] { return stopping || queued > 0; });
+                if (stopping && queued == 0) {
+                    return;
+                }
+            }
+            if (!popTask(index, task)) {
+                continue;
+            }
+            {
+                std::lock_guard<std::mutex> lock(sleepMutex);
+                queued--;
+            }
+            task();
+            task = nullptr;
+            if (--pending == 0) {
+                std::lock_guard<std::mutex> lock(sleepMutex);
+                idle.notify_all();
+            }
+        }
+    }
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    std::condition_variable idle;
+    int queued = 0;
+    bool stopping = false;
+    std::atomic<int> pending{0};
+    std::atomic<unsigned> nextQueue{0};
+};
+
+#endif
@@ -0,0 +1,423 @@
+#ifndef TILECACHE_H
+#define TILECACHE_H
+
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "escapekernel.h"
+#include "mappedfile.h"
+#include "viewport.h"
+
+// Iteration counts kept as a quadtree of fixed-size tiles. Level L has pixels
+// of PYRAMID_LEVEL0_PIXEL / 2^L and tile (tx, ty) covers pyramid pixels
+// [tx * PYRAMID_TILE, (tx + 1) * PYRAMID_TILE) and likewise in y, with pixel
+// (px, py) sampled at c = (px, py) * pixel size. Those are powers of two, so
+// every sample is exact and a pixel of level L is also pixel (2px, 2py) of
+// level L + 1: parents can be assembled from their children and children
+// seeded from their parent.
+const int PYRAMID_TILE = 64;
+const double PYRAMID_LEVEL0_PIXEL = 1.0 / 64;
+
+struct TileKey {
+    int level;
+    long long tx;
+    long long ty;
+    int maxIter;
+
+    bool operator==(const TileKey& other) const {
+        return level == other.level && tx == other.tx && ty == other.ty && maxIter == other.maxIter;
+    }
+
+    bool operator<(const TileKey& other) const {
+        if (level != other.level) return level < other.level;
+        if (tx != other.tx) return tx < other.tx;
+        if (ty != other.ty) return ty < other.ty;
+        return maxIter < other.maxIter;
+    }
+};
+
+struct TileKeyHash {
+    size_t operator()(const TileKey& key) const {
+        uint64_t h = (uint64_t)key.level * 0x9E3779B97F4A7C15ull;
+        h ^= (uint64_t)key.tx + 0x9E3779B97F4A7C15ull + (h << 6) + (h >> 2);
+        h ^= (uint64_t)key.ty + 0x9E3779B97F4A7C15ull + (h << 6) + (h >> 2);
+        h ^= (uint64_t)key.maxIter + 0x9E3779B97F4A7C15ull + (h << 6) + (h >> 2);
+        return (size_t)h;
+    }
+};
+
+typedef std::shared_ptr<const std::vector<int>> TileData;
+
+inline double pyramidPixelSize(int level) {
+    return std::ldexp(PYRAMID_LEVEL0_PIXEL, -level);
+}
+
+// The coarsest level whose pixels are no larger than pixelSize.
+inline int pyramidLevelFor(double pixelSize) {
+    int level = (int)std::ceil(std::log2(PYRAMID_LEVEL0_PIXEL / pixelSize));
+    return level < 0 ? 0 : level;
+}
+
+inline long long floorDiv(long long a, long long b) {
+    long long q = a / b;
+    return (a % b != 0 && (a < 0) != (b < 0)) ? q - 1 : q;
+}
+
+// Fixed number of tile slots in a memory-mapped file, addressed by hashing
+// the key with a short linear probe. A full probe overwrites its last slot,
+// so the file never grows. A slot's key is written after its iterations, so
+// a crash mid-write leaves an empty slot rather than a wrong tile. A file
+// holds the tiles of one formula (and Julia seed); opening it for another
+// one starts it over.
+class TileStore {
+public:
+    // Fails for a file that holds something other than a tile store, or a
+    // store whose header claims more slots than the file has.
+    bool open(const std::string& path, int slotCount, Formula formula, double seedRe, double seedIm) {
+        if (isForeignFile(path, MAGIC)) {
+            return false;
+        }
+        size_t size = sizeof(Header) + (size_t)slotCount * slotBytes();
+        if (!file.open(path, size)) {
+            return false;
+        }
+        Header* header = (Header*)file.data();
+        bool kept = header->magic == MAGIC && header->tileSize == PYRAMID_TILE && header->formula == formula &&
+                    header->seedRe == seedRe && header->seedIm == seedIm;
+        if (kept && (header->slotCount <= 0 || sizeof(Header) + (size_t)header->slotCount * slotBytes() > file.size())) {
+            file.close();
+            return false;
+        }
+        if (!kept) {
+            std::memset(file.data(), 0, file.size());
+            header->magic = MAGIC;
+            header->tileSize = PYRAMID_TILE;
+            header->slotCount = slotCount;
+            header->formula = formula;
+            header->seedRe = seedRe;
+            header->seedIm = seedIm;
+        }
+        slots = header->slotCount;
+        return true;
+    }
+
+    bool isOpen() const {
+        return file.isOpen();
+    }
+
+    bool load(const TileKey& key, std::vector<int>& iters) {
+        for (int probe = 0; probe < PROBES; ++probe) {
+            SlotKey* slot = slotKey(key, probe);
+            if (slot->used && slot->matches(key)) {
+                iters.assign((const int*)(slot + 1), (const int*)(slot + 1) + PYRAMID_TILE * PYRAMID_TILE);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void save(const TileKey& key, const std::vector<int>& iters) {
+        SlotKey* slot = nullptr;
+        for (int probe = 0; probe < PROBES; ++probe) {
+            slot = slotKey(key, probe);
+            if (!slot->used || slot->matches(key)) {
+                break;
+            }
+        }
+        slot->used = 0;
+        std::memcpy(slot + 1, iters.data(), iters.size() * sizeof(int));
+        slot->level = key.level;
+        slot->tx = key.tx;
+        slot->ty = key.ty;
+        slot->maxIter = key.maxIter;
+        slot->used = 1;
+    }
+
+    void flush() {
+        file.flush();
+    }
+
+private:
+    static const uint32_t MAGIC = 0x324C5454; // "TTL2"
+    static const int PROBES = 8;
+
+    struct Header {
+        uint32_t magic;
+        int32_t tileSize;
+        int32_t slotCount;
+        int32_t formula;
+        double seedRe;
+        double seedIm;
+    };
+
+    struct SlotKey {
+        int32_t used;
+        int32_t level;
+        int64_t tx;
+        int64_t ty;
+        int32_t maxIter;
+        int32_t reserved;
+
+        bool matches(const TileKey& key) const {
+            return level == key.level && tx == key.tx && ty == key.ty && maxIter == key.maxIter;
+        }
+    };
+
+    static size_t slotBytes() {
+        return sizeof(SlotKey) + PYRAMID_TILE * PYRAMID_TILE * sizeof(int);
+    }
+
+    SlotKey* slotKey(const TileKey& key, int probe) {
+        size_t index = (TileKeyHash()(key) + probe) % slots;
+        return (SlotKey*)(file.data() + sizeof(Header) + index * slotBytes());
+    }
+
+    MappedFile file;
+    int slots = 0;
+};
+
+// Bounded LRU of pyramid tiles in memory, backed by an optional TileStore
+// that every computed tile is written through to. span must iterate formula;
+// seedRe and seedIm are c for Julia sets.
+class TileCache {
+public:
+    struct Counters {
+        long long memoryHits = 0;
+        long long storeHits = 0;
+        long long assembled = 0;
+        long long seeded = 0;
+        long long computed = 0;
+    };
+
+    TileCache(EscapeSpanFn span, size_t capacity, Formula formula = FORMULA_MANDELBROT, double seedRe = 0.0,
+              double seedIm = 0.0)
+        : span(span), capacity(capacity), formula(formula), seedRe(seedRe), seedIm(seedIm) {
+    }
+
+    ~TileCache() {
+        store.flush();
+    }
+
+    bool openStore(const std::string& path, int slotCount) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return store.open(path, slotCount, formula, seedRe, seedIm);
+    }
+
+    // A tile that is cached, on disk or can be assembled from its cached
+    // children; null otherwise. Never computes anything.
+    TileData find(const TileKey& key) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return findLocked(key);
+    }
+
+    // Like find(), but computes the tile if needed. Concurrent callers asking
+    // for the same tile wait for the first one instead of duplicating work.
+    TileData get(const TileKey& key, EscapeStats& stats) {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            TileData data = findLocked(key);
+            if (data) {
+                return data;
+            }
+            if (computing.count(key) == 0) {
+                break;
+            }
+            computed.wait(lock);
+        }
+        computing.insert(key);
+        TileData parent = key.level > 0 ? memoryLookup(parentKey(key)) : TileData();
+        lock.unlock();
+
+        std::shared_ptr<std::vector<int>> tile = std::make_shared<std::vector<int>>(PYRAMID_TILE * PYRAMID_TILE);
+        computeTile(key, parent, *tile, stats);
+
+        lock.lock();
+        counters.computed++;
+        counters.seeded += parent ? 1 : 0;
+        if (store.isOpen()) {
+            store.save(key, *tile);
+        }
+        insertLocked(key, tile);
+        computing.erase(key);
+        computed.notify_all();
+        return tile;
+    }
+
+    Counters getCounters() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return counters;
+    }
+
+    // Computes pixel (px, py) of the level at the c a tile would use, without
+    // caching it.
+    void computeSample(int level, long long px, long long py, int maxIter, int* iter, EscapeStats& stats) const {
+        double pixel = pyramidPixelSize(level);
+        EscapeRow sample = { (double)px * pixel, pixel, (double)py * pixel, 0, 1, 1,
+                             maxIter, true, iter, nullptr, nullptr, seedRe, seedIm };
+        span(sample, stats);
+    }
+
+private:
+    typedef std::list<std::pair<TileKey, TileData>> LruList;
+
+    static TileKey parentKey(const TileKey& key) {
+        return { key.level - 1, floorDiv(key.tx, 2), floorDiv(key.ty, 2), key.maxIter };
+    }
+
+    TileData memoryLookup(const TileKey& key) {
+        auto found = index.find(key);
+        if (found == index.end()) {
+            return TileData();
+        }
+        lru.splice(lru.begin(), lru, found->second);
+        return found->second->second;
+    }
+
+    TileData findLocked(const TileKey& key) {
+        TileData data = memoryLookup(key);
+        if (data) {
+            counters.memoryHits++;
+            return data;
+        }
+
+        if (store.isOpen()) {
+            std::shared_ptr<std::vector<int>> tile = std::make_shared<std::vector<int>>();
+            if (store.load(key, *tile)) {
+                counters.storeHits++;
+                insertLocked(key, tile);
+                return tile;
+            }
+        }
+
+        TileData children[4];
+        for (int i = 0; i < 4; ++i) {
+            children[i] = memoryLookup({ key.level + 1, 2 * key.tx + (i & 1), 2 * key.ty + (i >> 1), key.maxIter });
+            if (!children[i]) {
+                return TileData();
+            }
+        }
+        std::shared_ptr<std::vector<int>> tile = std::make_shared<std::vector<int>>(PYRAMID_TILE * PYRAMID_TILE);
+        for (int y = 0; y < PYRAMID_TILE; ++y) {
+            for (int x = 0; x < PYRAMID_TILE; ++x) {
+                int cx = 2 * x, cy = 2 * y;
+                const std::vector<int>& child = *children[(cx / PYRAMID_TILE) + 2 * (cy / PYRAMID_TILE)];
+                (*tile)[y * PYRAMID_TILE + x] = child[(cy % PYRAMID_TILE) * PYRAMID_TILE + cx % PYRAMID_TILE];
+            }
+        }
+        counters.assembled++;
+        if (store.isOpen()) {
+            store.save(key, *tile);
+        }
+        insertLocked(key, tile);
+        return tile;
+    }
+
+    void insertLocked(const TileKey& key, TileData data) {
+        auto found = index.find(key);
+        if (found != index.end()) {
+            lru.erase(found->second);
+        }
+        lru.emplace_front(key, data);
+        index[key] = lru.begin();
+        while (lru.size() > capacity) {
+            index.erase(lru.back().first);
+            lru.pop_back();
+        }
+    }
+
+    // Rows are computed with re0 = tx * PYRAMID_TILE * pixel and x0 = 0 so c
+    // stays exact however large the tile indices get. Pixels shared with the
+    // parent tile are copied from it when it is cached.
+    void computeTile(const TileKey& key, const TileData& parent, std::vector<int>& iters, EscapeStats& stats) {
+        double pixel = pyramidPixelSize(key.level);
+        double re0 = (double)(key.tx * PYRAMID_TILE) * pixel;
+        int parentX = (int)(key.tx - 2 * floorDiv(key.tx, 2)) * PYRAMID_TILE / 2;
+        int parentY = (int)(key.ty - 2 * floorDiv(key.ty, 2)) * PYRAMID_TILE / 2;
+
+        for (int y = 0; y < PYRAMID_TILE; ++y) {
+            double im = (double)(key.ty * PYRAMID_TILE + y) * pixel;
+            int* row = &iters[y * PYRAMID_TILE];
+            if (parent && y % 2 == 0) {
+                const int* parentRow = &(*parent)[(parentY + y / 2) * PYRAMID_TILE + parentX];
+                for (int x = 0; x < PYRAMID_TILE; x += 2) {
+                    row[x] = parentRow[x / 2];
+                }
+                std::vector<int> odd(PYRAMID_TILE / 2);
+                EscapeRow oddColumns = { re0, pixel, im, 1, 2, PYRAMID_TILE / 2, key.maxIter, true, odd.data(),
+                                         nullptr, nullptr, seedRe, seedIm };
+                span(oddColumns, stats);
+                for (int x = 1; x < PYRAMID_TILE; x += 2) {
+                    row[x] = odd[x / 2];
+                }
+            } else {
+                EscapeRow all = { re0, pixel, im, 0, 1, PYRAMID_TILE, key.maxIter, true, row, nullptr, nullptr,
+                                  seedRe, seedIm };
+                span(all, stats);
+            }
+        }
+    }
+
+    EscapeSpanFn span;
+    size_t capacity;
+    Formula formula;
+    double seedRe;
+    double seedIm;
+    std::mutex mutex;
+    std::condition_variable computed;
+    std::set<TileKey> computing;
+    LruList lru;
+    std::unordered_map<TileKey, LruList::iterator, TileKeyHash> index;
+    TileStore store;
+    Counters counters;
+};
+
+// Row function for TileRenderer that shows a view through the pyramid, at
+// the coarsest level that is at least as fine as the view. Full-resolution
+// passes fetch (and if needed compute) whole tiles; coarser passes use tiles
+// that are already available and otherwise compute just the sample, at the
+// same c the tile would use. Tiles only hold whole iteration counts, so the
+// smooth counts are those too.
+struct PyramidRows {
+    TileCache* cache;
+    Viewport view;
+    int maxIter;
+
+    void operator()(int y, int x0, int step, int count, int* iters, float* smooth, EscapeStats& stats) const {
+        int level = pyramidLevelFor(std::min(view.dre, view.dim));
+        double pixel = pyramidPixelSize(level);
+        long long py = (long long)std::floor((view.im0 + y * view.dim) / pixel);
+        long long ty = floorDiv(py, PYRAMID_TILE);
+        int oy = (int)(py - ty * PYRAMID_TILE);
+
+        TileData data;
+        long long dataTx = 0;
+        for (int k = 0; k < count; ++k) {
+            long long px = (long long)std::floor((view.re0 + (x0 + k * step) * view.dre) / pixel);
+            long long tx = floorDiv(px, PYRAMID_TILE);
+            if (!data || tx != dataTx) {
+                TileKey key = { level, tx, ty, maxIter };
+                data = step == 1 ? cache->get(key, stats) : cache->find(key);
+                dataTx = tx;
+            }
+            if (data) {
+                iters[k] = (*data)[oy * PYRAMID_TILE + (int)(px - tx * PYRAMID_TILE)];
+            } else {
+                cache->computeSample(level, px, py, maxIter, &iters[k], stats);
+            }
+            if (smooth) {
+                smooth[k] = (float)iters[k];
+            }
+        }
+    }
+};
+
+#endif
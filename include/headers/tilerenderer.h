@@ -0,0 +1,648 @@
+#ifndef TILERENDERER_H
+#define TILERENDERER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "escapekernel.h"
+#include "threadpool.h"
+#include "viewport.h"
+
+struct Tile {
+    int x;
+    int y;
+    int width;
+    int height;
+};
+
+// Where the pixels of a new frame lie in the current one: pixel (x, y) of the
+// new frame is at (offsetX + scale * x, offsetY + scale * y). With reuse set,
+// pixels that land exactly on pixels of a finished current frame keep their
+// counts, which is only right if the new frame computes them the same way.
+struct Warp {
+    double scale = 1.0;
+    double offsetX = 0.0;
+    double offsetY = 0.0;
+    bool reuse = false;
+
+    // inner first, then this warp.
+    Warp after(const Warp& inner) const {
+        return { scale * inner.scale, offsetX + scale * inner.offsetX, offsetY + scale * inner.offsetY, reuse };
+    }
+};
+
+inline std::vector<Tile> makeTiles(int width, int height, int tileSize) {
+    std::vector<Tile> tiles;
+    for (int y = 0; y < height; y += tileSize) {
+        for (int x = 0; x < width; x += tileSize) {
+            tiles.push_back({ x, y, std::min(tileSize, width - x), std::min(tileSize, height - y) });
+        }
+    }
+    return tiles;
+}
+
+// Computes count pixels of row y, at columns x0, x0 + step, ..., into iters,
+// and their smooth iteration counts into smooth unless it is null.
+typedef std::function<void(int y, int x0, int step, int count, int* iters, float* smooth, EscapeStats& stats)>
+    RowFunction;
+
+// Renders the iteration counts of a frame as small tiles on a thread pool.
+// Per-pixel cost varies wildly across the image, so tiles are kept small and
+// left to the pool's work stealing to balance. Finished tiles are queued for
+// the caller, which can show them while the rest of the frame is computed.
+//
+// A frame is computed coarse to fine: the first pass samples every
+// coarsestStep-th pixel, and each following pass halves the step and only
+// computes the pixels the earlier passes have not. Every sample is written
+// over its whole step x step block, so the buffer always holds a complete
+// (if blocky) image. Starting a new frame cancels the one in flight; its
+// tasks notice at the next row and drop their work.
+//
+// With subdivision on, a frame is computed by Mariani-Silver subdivision
+// instead: only the border of a rectangle is computed, and if every border
+// pixel has the same count the inside is filled with it. Otherwise the
+// rectangle is cut into four by a computed cross and each quarter becomes a
+// task of its own. Smooth counts inside a filled rectangle are interpolated
+// between its left and right edge.
+//
+// Frames started from a view can keep every pixel's orbit, so once one is
+// finished deepen() can raise its cap: pixels that escaped keep their counts
+// and only the others are iterated further, from where they stopped.
+//
+// A frame started with a Warp begins as the current frame warped into its
+// view, so the caller can show the moved image at once. Tiles the warp
+// leaves partly uncovered are computed first, coarse to fine. Tiles it
+// covers are computed only by the last pass and show the warped image until
+// then. With reuse, tiles moved by whole pixels at the same scale are kept
+// as they are, so panning only computes the strips it reveals.
+class TileRenderer {
+public:
+    TileRenderer(ThreadPool& pool, EscapeSpanFn span, int width, int height, int coarsestStep = 8, int tileSize = 32)
+        : pool(pool), span(span), width(width), height(height), coarsestStep(coarsestStep), tileSize(tileSize) {
+    }
+
+    ~TileRenderer() {
+        cancel();
+    }
+
+    // Applies to frames started after the call.
+    void setKernel(EscapeSpanFn kernel) {
+        span = kernel;
+    }
+
+    // Applies to frames started after the call.
+    void setShortcuts(bool enabled) {
+        shortcuts = enabled;
+    }
+
+    // Also keep smooth iteration counts, for frames started after the call.
+    void setSmooth(bool enabled) {
+        smooth = enabled;
+    }
+
+    // Applies to frames started after the call.
+    void setSubdivision(bool enabled) {
+        subdivision = enabled;
+    }
+
+    // c for kernels of Julia sets, for frames started after the call.
+    void setSeed(double re, double im) {
+        seedRe = re;
+        seedIm = im;
+    }
+
+    // Also keep every pixel's orbit, so deepen() can continue frames started
+    // from a view after the call. Costs 24 bytes per pixel.
+    void setResumable(bool enabled) {
+        resumable = enabled;
+    }
+
+    void start(const Viewport& view, int maxIter, const Warp* warp = nullptr) {
+        cancel();
+        std::shared_ptr<Frame> next = newFrame(RowFunction());
+        if (resumable) {
+            next->orbits = std::make_shared<std::vector<EscapeOrbit>>(width * height);
+        }
+        next->maxIter = maxIter;
+        if (warp) {
+            reproject(*next, *warp);
+        }
+        next->view = view;
+        next->kernel = span;
+        next->shortcuts = shortcuts;
+        next->seedRe = seedRe;
+        next->seedIm = seedIm;
+        next->rows = viewRows(*next);
+        launch(next);
+    }
+
+    // Renders a frame whose pixels come from rows instead of the escape
+    // kernel. maxIter is the cap rows count to.
+    void start(RowFunction rows, int maxIter, const Warp* warp = nullptr) {
+        cancel();
+        std::shared_ptr<Frame> next = newFrame(std::move(rows));
+        next->maxIter = maxIter;
+        if (warp) {
+            reproject(*next, *warp);
+        }
+        launch(next);
+    }
+
+    // Shows the current frame warped by warp, as start() would, without
+    // computing anything: for a frame whose rows are not ready yet, which
+    // the next start() then begins from.
+    void hold(int maxIter, const Warp& warp) {
+        cancel();
+        std::shared_ptr<Frame> next = newFrame(RowFunction());
+        next->maxIter = maxIter;
+        reproject(*next, warp);
+        std::lock_guard<std::mutex> lock(mutex);
+        frame = next;
+    }
+
+    // Raises the cap of the current frame to maxIter, continuing only the
+    // pixels that had not escaped. Returns false, and leaves the frame alone,
+    // unless it was started from a view with setResumable(true), has
+    // finished, was started with the current setSmooth setting and maxIter is
+    // higher than its cap.
+    bool deepen(int maxIter) {
+        std::shared_ptr<Frame> previous = currentFrame();
+        if (!previous || !previous->orbits || maxIter <= previous->maxIter || previous->smooth.empty() == smooth) {
+            return false;
+        }
+        {
+            std::lock_guard<std::mutex> lock(previous->mutex);
+            if (!previous->complete) {
+                return false;
+            }
+        }
+        std::shared_ptr<Frame> next = newFrame(RowFunction());
+        next->iters = previous->iters;
+        next->smooth = previous->smooth;
+        next->orbits = previous->orbits;
+        next->view = previous->view;
+        next->kernel = previous->kernel;
+        next->shortcuts = previous->shortcuts;
+        next->seedRe = previous->seedRe;
+        next->seedIm = previous->seedIm;
+        next->maxIter = maxIter;
+        next->rows = viewRows(*next);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            frame = next;
+        }
+        next->remaining = (int)next->tiles.size();
+        for (const Tile& tile : next->tiles) {
+            pool.submit([next, tile] { deepenTile(next, tile); });
+        }
+        return true;
+    }
+
+    void cancel() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (frame) {
+            frame->cancelled = true;
+        }
+    }
+
+    // Moves the tiles updated since the last call into tiles.
+    void takeFinished(std::vector<Tile>& tiles) {
+        tiles.clear();
+        std::shared_ptr<Frame> current = currentFrame();
+        if (current) {
+            std::lock_guard<std::mutex> lock(current->mutex);
+            tiles.swap(current->finished);
+        }
+    }
+
+    bool done() const {
+        std::shared_ptr<Frame> current = currentFrame();
+        if (!current) {
+            return true;
+        }
+        std::lock_guard<std::mutex> lock(current->mutex);
+        return current->complete;
+    }
+
+    void wait() {
+        std::shared_ptr<Frame> current = currentFrame();
+        if (current) {
+            std::unique_lock<std::mutex> lock(current->mutex);
+            current->allDone.wait(lock, [&] { return current->complete || current->cancelled; });
+        }
+    }
+
+    // Iterations of the current frame. Pixels the running passes have not
+    // reached yet hold the value of the coarser sample covering them, or of
+    // the warped previous frame.
+    const std::vector<int>& iterations() const {
+        return currentFrame()->iters;
+    }
+
+    // Smooth counts of the current frame; empty unless setSmooth(true).
+    const std::vector<float>& smoothIterations() const {
+        return currentFrame()->smooth;
+    }
+
+    EscapeStats stats() const {
+        std::shared_ptr<Frame> current = currentFrame();
+        if (!current) {
+            return EscapeStats();
+        }
+        std::lock_guard<std::mutex> lock(current->mutex);
+        return current->stats;
+    }
+
+    // Pixels of the current frame actually computed so far.
+    long long samples() const {
+        std::shared_ptr<Frame> current = currentFrame();
+        return current ? current->samples.load() : 0;
+    }
+
+private:
+    struct Frame {
+        ThreadPool* pool;
+        RowFunction rows;
+        int width;
+        int height;
+        int coarsestStep;
+
+        // Tiles from firstCovered on were covered by a warp and only have the
+        // last pass.
+        std::vector<Tile> tiles;
+        int firstCovered = 0;
+        std::vector<int> iters;
+        std::vector<float> smooth;
+        std::vector<Tile> finished;
+        std::mutex mutex;
+        std::condition_variable allDone;
+        bool complete = false;
+        std::atomic<bool> cancelled{false};
+        std::atomic<int> remaining{0};
+        std::atomic<long long> samples{0};
+        EscapeStats stats;
+
+        // Set for frames started from a view, which deepen() can continue.
+        std::shared_ptr<std::vector<EscapeOrbit>> orbits;
+        Viewport view;
+        EscapeSpanFn kernel = nullptr;
+        bool shortcuts = false;
+        double seedRe = 0.0;
+        double seedIm = 0.0;
+        int maxIter = 0;
+    };
+
+    // Inclusive pixel bounds.
+    struct Rect {
+        int x0;
+        int y0;
+        int x1;
+        int y1;
+    };
+
+    // Rectangles this narrow are computed rather than split further.
+    static const int MIN_SUBDIVISION = 32;
+
+    std::shared_ptr<Frame> currentFrame() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return frame;
+    }
+
+    // Rows of a frame started from a view, with the frame's kernel settings.
+    static RowFunction viewRows(const Frame& frame) {
+        EscapeSpanFn kernel = frame.kernel;
+        EscapeRow base = { frame.view.re0, frame.view.dre, frame.view.im0, 0, 1, 0, frame.maxIter, frame.shortcuts,
+                           nullptr, nullptr, frame.orbits ? frame.orbits->data() : nullptr, frame.seedRe, frame.seedIm };
+        double dim = frame.view.dim;
+        int stride = frame.width;
+        return [kernel, base, dim, stride](int y, int x0, int step, int count, int* iters, float* smooth,
+                                           EscapeStats& stats) {
+            EscapeRow row = base;
+            row.im = base.im + y * dim;
+            row.x0 = x0;
+            row.step = step;
+            row.count = count;
+            row.iters = iters;
+            row.smooth = smooth;
+            row.orbits = base.orbits ? base.orbits + y * stride : nullptr;
+            kernel(row, stats);
+        };
+    }
+
+    std::shared_ptr<Frame> newFrame(RowFunction rows) const {
+        std::shared_ptr<Frame> next = std::make_shared<Frame>();
+        next->pool = &pool;
+        next->rows = std::move(rows);
+        next->width = width;
+        next->height = height;
+        next->coarsestStep = coarsestStep;
+        next->tiles = makeTiles(width, height, tileSize);
+        next->firstCovered = (int)next->tiles.size();
+        next->iters.assign(width * height, 0);
+        if (smooth) {
+            next->smooth.assign(width * height, 0.0f);
+        }
+        return next;
+    }
+
+    // Fills next from the current frame warped by warp. Pixels the warp
+    // moves outside it take the nearest edge pixel. Counts past next's cap,
+    // from a frame with a higher one, are cut down to it, which is what they
+    // come to at that cap. Reorders next's tiles: those not wholly covered
+    // first, then covered ones. With reuse, drops covered tiles that are
+    // exact copies, and copies their orbits.
+    void reproject(Frame& next, const Warp& warp) const {
+        std::shared_ptr<Frame> previous = currentFrame();
+        if (!previous) {
+            return;
+        }
+        bool whole = warp.scale == 1.0 && warp.offsetX == std::floor(warp.offsetX) &&
+                     warp.offsetY == std::floor(warp.offsetY);
+        bool exact = warp.reuse && whole && !subdivision && previous->smooth.empty() == next.smooth.empty() &&
+                     (previous->orbits != nullptr) == (next.orbits != nullptr);
+        if (exact) {
+            std::lock_guard<std::mutex> lock(previous->mutex);
+            exact = previous->complete;
+        }
+
+        // The warp is separable, so every column and row maps on its own.
+        std::vector<int> column(width), row(height);
+        for (int x = 0; x < width; ++x) {
+            column[x] = (int)std::floor(warp.offsetX + warp.scale * x + 0.5);
+        }
+        for (int y = 0; y < height; ++y) {
+            row[y] = (int)std::floor(warp.offsetY + warp.scale * y + 0.5);
+        }
+        bool smoothToo = !previous->smooth.empty() && !next.smooth.empty();
+        for (int y = 0; y < height; ++y) {
+            int sourceRow = std::min(std::max(row[y], 0), height - 1) * width;
+            for (int x = 0; x < width; ++x) {
+                int source = sourceRow + std::min(std::max(column[x], 0), width - 1);
+                next.iters[y * width + x] = std::min(previous->iters[source], next.maxIter);
+                if (smoothToo) {
+                    next.smooth[y * width + x] = std::min(previous->smooth[source], (float)next.maxIter);
+                }
+            }
+        }
+
+        std::vector<Tile> uncovered, covered;
+        for (const Tile& tile : next.tiles) {
+            int right = tile.x + tile.width - 1, bottom = tile.y + tile.height - 1;
+            bool inside = column[tile.x] >= 0 && column[right] < width && row[tile.y] >= 0 && row[bottom] < height;
+            if (!inside) {
+                uncovered.push_back(tile);
+            } else if (!exact) {
+                covered.push_back(tile);
+            } else if (next.orbits) {
+                for (int y = tile.y; y <= bottom; ++y) {
+                    std::copy(&(*previous->orbits)[row[y] * width + column[tile.x]],
+                              &(*previous->orbits)[row[y] * width + column[right]] + 1,
+                              &(*next.orbits)[y * width + tile.x]);
+                }
+            }
+        }
+        next.firstCovered = (int)uncovered.size();
+        next.tiles = uncovered;
+        next.tiles.insert(next.tiles.end(), covered.begin(), covered.end());
+    }
+
+    void launch(const std::shared_ptr<Frame>& next) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            frame = next;
+        }
+        if (subdivision) {
+            startSubdivision(next);
+        } else {
+            startPass(next, coarsestStep);
+        }
+    }
+
+    // Passes with no tiles, as when a warp covers the frame, are skipped.
+    static void startPass(const std::shared_ptr<Frame>& frame, int step) {
+        int count = step == 1 ? (int)frame->tiles.size() : frame->firstCovered;
+        while (count == 0 && step > 1) {
+            step /= 2;
+            count = step == 1 ? (int)frame->tiles.size() : frame->firstCovered;
+        }
+        if (count == 0) {
+            std::lock_guard<std::mutex> lock(frame->mutex);
+            frame->complete = !frame->cancelled;
+            frame->allDone.notify_all();
+            return;
+        }
+        frame->remaining = count;
+        for (int i = 0; i < count; ++i) {
+            Tile tile = frame->tiles[i];
+            bool sampled = step < frame->coarsestStep && i < frame->firstCovered;
+            frame->pool->submit([frame, tile, step, sampled] { renderTile(frame, tile, step, sampled); });
+        }
+    }
+
+    // sampled says the earlier passes went over the tile.
+    static void renderTile(const std::shared_ptr<Frame>& frame, const Tile& tile, int step, bool sampled) {
+        std::vector<int> samples(tile.width);
+        std::vector<float> smoothSamples(frame->smooth.empty() ? 0 : tile.width);
+        float* smooth = frame->smooth.empty() ? nullptr : smoothSamples.data();
+        EscapeStats stats;
+
+        // Tiles are aligned to the coarsest step, so the sample grid is the
+        // same whichever tile a pixel falls in.
+        int y0 = (tile.y + step - 1) / step * step;
+        int x0 = (tile.x + step - 1) / step * step;
+        for (int y = y0; y < tile.y + tile.height; y += step) {
+            if (frame->cancelled) {
+                break;
+            }
+
+            // On rows the previous pass sampled, only the odd columns are new.
+            bool sampledRow = sampled && y % (2 * step) == 0;
+            int first = sampledRow ? x0 + step : x0;
+            int stride = sampledRow ? 2 * step : step;
+            if (first >= tile.x + tile.width) {
+                continue;
+            }
+            int count = (tile.x + tile.width - first + stride - 1) / stride;
+            frame->rows(y, first, stride, count, samples.data(), smooth, stats);
+            frame->samples += count;
+
+            int blockBottom = std::min(y + step, tile.y + tile.height);
+            for (int k = 0; k < count; ++k) {
+                int x = first + k * stride;
+                int blockRight = std::min(x + step, tile.x + tile.width);
+                for (int by = y; by < blockBottom; ++by) {
+                    std::fill(&frame->iters[by * frame->width + x], &frame->iters[by * frame->width + blockRight], samples[k]);
+                    if (smooth) {
+                        std::fill(&frame->smooth[by * frame->width + x], &frame->smooth[by * frame->width + blockRight],
+                                  smooth[k]);
+                    }
+                }
+            }
+        }
+        bool passDone;
+        {
+            std::lock_guard<std::mutex> lock(frame->mutex);
+            frame->stats.add(stats);
+            frame->finished.push_back(tile);
+            passDone = --frame->remaining == 0;
+            if (passDone && (step == 1 || frame->cancelled)) {
+                frame->complete = !frame->cancelled;
+                frame->allDone.notify_all();
+                return;
+            }
+        }
+        if (passDone) {
+            startPass(frame, step / 2);
+        }
+    }
+
+    // Computes count pixels of row y from column x straight into the frame.
+    static void computeSpan(const std::shared_ptr<Frame>& frame, int y, int x, int count, EscapeStats& stats) {
+        int offset = y * frame->width + x;
+        frame->rows(y, x, 1, count, &frame->iters[offset], frame->smooth.empty() ? nullptr : &frame->smooth[offset],
+                    stats);
+        frame->samples += count;
+    }
+
+    static void startSubdivision(const std::shared_ptr<Frame>& frame) {
+        frame->remaining = 1;
+        frame->pool->submit([frame] {
+            EscapeStats stats;
+            int right = frame->width - 1;
+            int bottom = frame->height - 1;
+            computeSpan(frame, 0, 0, frame->width, stats);
+            if (bottom > 0) {
+                computeSpan(frame, bottom, 0, frame->width, stats);
+            }
+            for (int y = 1; y < bottom; ++y) {
+                computeSpan(frame, y, 0, 1, stats);
+                if (right > 0) {
+                    computeSpan(frame, y, right, 1, stats);
+                }
+            }
+            subdivide(frame, { 0, 0, right, bottom }, stats);
+        });
+    }
+
+    // Handles a rectangle whose border is already computed. Every call ends
+    // one unit of frame->remaining.
+    static void subdivide(const std::shared_ptr<Frame>& frame, Rect rect, EscapeStats& stats) {
+        bool leaf = true;
+        if (!frame->cancelled) {
+            int value;
+            if (uniformBorder(*frame, rect, value)) {
+                fillInside(*frame, rect, value);
+            } else if (rect.x1 - rect.x0 <= MIN_SUBDIVISION || rect.y1 - rect.y0 <= MIN_SUBDIVISION) {
+                for (int y = rect.y0 + 1; y < rect.y1; ++y) {
+                    computeSpan(frame, y, rect.x0 + 1, rect.x1 - rect.x0 - 1, stats);
+                }
+            } else {
+                // The cross is shared by the quarters as their inner edges.
+                int mx = (rect.x0 + rect.x1) / 2;
+                int my = (rect.y0 + rect.y1) / 2;
+                computeSpan(frame, my, rect.x0 + 1, rect.x1 - rect.x0 - 1, stats);
+                for (int y = rect.y0 + 1; y < rect.y1; ++y) {
+                    if (y != my) {
+                        computeSpan(frame, y, mx, 1, stats);
+                    }
+                }
+                leaf = false;
+                Rect quarters[4] = { { rect.x0, rect.y0, mx, my }, { mx, rect.y0, rect.x1, my },
+                                     { rect.x0, my, mx, rect.y1 }, { mx, my, rect.x1, rect.y1 } };
+                frame->remaining += 4;
+                for (const Rect& quarter : quarters) {
+                    frame->pool->submit([frame, quarter] {
+                        EscapeStats quarterStats;
+                        subdivide(frame, quarter, quarterStats);
+                    });
+                }
+            }
+        }
+
+        finishTask(*frame, stats, leaf, { rect.x0, rect.y0, rect.x1 - rect.x0 + 1, rect.y1 - rect.y0 + 1 });
+    }
+
+    // Continues a finished frame's orbits over one tile, writing straight into
+    // buffers that already hold the previous counts.
+    static void deepenTile(const std::shared_ptr<Frame>& frame, const Tile& tile) {
+        EscapeStats stats;
+        for (int y = tile.y; y < tile.y + tile.height && !frame->cancelled; ++y) {
+            computeSpan(frame, y, tile.x, tile.width, stats);
+        }
+        finishTask(*frame, stats, true, tile);
+    }
+
+    // Ends one unit of frame.remaining, queueing tile for display if show is
+    // set.
+    static void finishTask(Frame& frame, const EscapeStats& stats, bool show, const Tile& tile) {
+        std::lock_guard<std::mutex> lock(frame.mutex);
+        frame.stats.add(stats);
+        if (show && !frame.cancelled) {
+            frame.finished.push_back(tile);
+        }
+        if (--frame.remaining == 0) {
+            frame.complete = !frame.cancelled;
+            frame.allDone.notify_all();
+        }
+    }
+
+    static bool uniformBorder(const Frame& frame, const Rect& rect, int& value) {
+        const int* iters = frame.iters.data();
+        value = iters[rect.y0 * frame.width + rect.x0];
+        for (int x = rect.x0; x <= rect.x1; ++x) {
+            if (iters[rect.y0 * frame.width + x] != value || iters[rect.y1 * frame.width + x] != value) {
+                return false;
+            }
+        }
+        for (int y = rect.y0 + 1; y < rect.y1; ++y) {
+            if (iters[y * frame.width + rect.x0] != value || iters[y * frame.width + rect.x1] != value) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Filled pixels that escaped count as escaped when the frame is deepened;
+    // the others start their orbits from scratch then.
+    static void fillInside(Frame& frame, const Rect& rect, int value) {
+        for (int y = rect.y0 + 1; y < rect.y1; ++y) {
+            int offset = y * frame.width;
+            std::fill(&frame.iters[offset + rect.x0 + 1], &frame.iters[offset + rect.x1], value);
+            if (frame.orbits && value < frame.maxIter) {
+                for (int x = rect.x0 + 1; x < rect.x1; ++x) {
+                    (*frame.orbits)[offset + x].state = ORBIT_ESCAPED;
+                }
+            }
+            if (!frame.smooth.empty()) {
+                float left = frame.smooth[offset + rect.x0];
+                float right = frame.smooth[offset + rect.x1];
+                for (int x = rect.x0 + 1; x < rect.x1; ++x) {
+                    frame.smooth[offset + x] = left + (right - left) * (x - rect.x0) / (rect.x1 - rect.x0);
+                }
+            }
+        }
+    }
+
+    ThreadPool& pool;
+    EscapeSpanFn span;
+    int width;
+    int height;
+    int coarsestStep;
+    int tileSize;
+    bool shortcuts = true;
+    bool smooth = false;
+    bool subdivision = false;
+    bool resumable = false;
+    double seedRe = 0.0;
+    double seedIm = 0.0;
+    mutable std::mutex mutex;
+    std::shared_ptr<Frame> frame;
+};
+
+#endif
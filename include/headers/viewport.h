@@ -0,0 +1,42 @@
+#ifndef VIEWPORT_H
+#define VIEWPORT_H
+
+#include <complex>
+
+// Maps pixel (x, y) to c = (re0 + x * dre, im0 + y * dim).
+struct Viewport {
+    double re0;
+    double im0;
+    double dre;
+    double dim;
+};
+
+inline std::complex<double> pixelToComplex(const Viewport& view, int x, int y) {
+    return std::complex<double>(view.re0 + x * view.dre, view.im0 + y * view.dim);
+}
+
+// Square pixels, with the given width in the complex plane and centre.
+inline Viewport centeredViewport(double centerRe, double centerIm, double width, int pixelsWide, int pixelsHigh) {
+    double pixel = width / pixelsWide;
+    return { centerRe - pixel * pixelsWide / 2, centerIm - pixel * pixelsHigh / 2, pixel, pixel };
+}
+
+// Scales the pixel size by factor, keeping the point under pixel (x, y) fixed.
+inline Viewport zoomViewport(const Viewport& view, int x, int y, double factor) {
+    Viewport zoomed = view;
+    zoomed.dre = view.dre * factor;
+    zoomed.dim = view.dim * factor;
+    zoomed.re0 = view.re0 + x * (view.dre - zoomed.dre);
+    zoomed.im0 = view.im0 + y * (view.dim - zoomed.dim);
+    return zoomed;
+}
+
+// Moves the image by (dx, dy) pixels, as when it is dragged by the mouse.
+inline Viewport panViewport(const Viewport& view, int dx, int dy) {
+    Viewport panned = view;
+    panned.re0 = view.re0 - dx * view.dre;
+    panned.im0 = view.im0 - dy * view.dim;
+    return panned;
+}
+
+#endif
@@ -3,6 +3,8 @@
 #include <iostream>
 #include <cmath>
 
+#include "framebuffer.h"
+
 const int SCREEN_WIDTH = 600;
 const int SCREEN_HEIGHT = 600;
 const int GRID_SIZE = 100;
@@ -66,6 +68,9 @@ int main(int argc, char* args[]) {
     SDL_Window* window = SDL_CreateWindow("Heat Diffusion Simulation", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, SCREEN_WIDTH, SCREEN_HEIGHT, SDL_WINDOW_SHOWN);
     SDL_Renderer* renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
 
+    // One texel per grid cell; the copy to the window does the scaling.
+    Framebuffer framebuffer(renderer, GRID_SIZE, GRID_SIZE);
+
     initializeTemperature();
 
     bool quit = false;
@@ -86,23 +91,15 @@ int main(int argc, char* args[]) {
 
         updateTemperature();
 
-        SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-        SDL_RenderClear(renderer);
-
-        int cellWidth = SCREEN_WIDTH / GRID_SIZE;
-        int cellHeight = SCREEN_HEIGHT / GRID_SIZE;
-
         for (int i = 0; i < GRID_SIZE; ++i) {
             for (int j = 0; j < GRID_SIZE; ++j) {
                 int r, g, b;
                 getColor(temperature[i][j], r, g, b);
-                SDL_SetRenderDrawColor(renderer, r, g, b, 255);
-                SDL_Rect rect = { i * cellWidth, j * cellHeight, cellWidth, cellHeight };
-                SDL_RenderFillRect(renderer, &rect);
+                framebuffer.setPixel(i, j, packColor(r, g, b));
             }
         }
 
-        SDL_RenderPresent(renderer);
+        framebuffer.present();
         SDL_Delay(30);
     }
 
@@ -3,6 +3,8 @@
 #include <cmath>
 #include <vector>
 
+#include "framebuffer.h"
+
 const double sigma = 10.0;
 const double rho = 28.0;
 const double beta = 8.0 / 3.0;
@@ -29,6 +31,7 @@ int main(int argc, char* argv[]) {
 
     SDL_Window* window = SDL_CreateWindow("Lorenz Attractor", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, SCREEN_WIDTH, SCREEN_HEIGHT, SDL_WINDOW_SHOWN);
     SDL_Renderer* renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+    Framebuffer framebuffer(renderer, SCREEN_WIDTH, SCREEN_HEIGHT);
 
     double x1 = 0.01, y1 = 0.0, z1 = 0.0;
     double x2 = 0.02, y2 = 0.0, z2 = 0.0;
@@ -55,15 +58,13 @@ int main(int argc, char* argv[]) {
             int pointY2 = (int)((z2 + 0) * (SCREEN_HEIGHT / 50));
 
             if (pointX1 >= 0 && pointX1 < SCREEN_WIDTH && pointY1 >= 0 && pointY1 < SCREEN_HEIGHT) {
-                SDL_SetRenderDrawColor(renderer, 0, 255, 0, 255); // Green
-                SDL_RenderDrawPoint(renderer, pointX1, pointY1);
+                framebuffer.setPixel(pointX1, pointY1, packColor(0, 255, 0)); // Green
             }
 
             if (pointX2 >= 0 && pointX2 < SCREEN_WIDTH && pointY2 >= 0 && pointY2 < SCREEN_HEIGHT) {
-                SDL_SetRenderDrawColor(renderer, 255, 0, 0, 255); // Red
-                SDL_RenderDrawPoint(renderer, pointX2, pointY2);
+                framebuffer.setPixel(pointX2, pointY2, packColor(255, 0, 0)); // Red
             }
-            SDL_RenderPresent(renderer);
+            framebuffer.present();
             SDL_Delay(10);
         }
 
@@ -1,41 +1,1703 @@
 #include <SDL.h>
-#include <complex>
+#include <SDL_image.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
 #include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "accumulator.h"
+#include "buddhabrot.h"
+#include "escapekernel.h"
+#include "expmap.h"
+#include "fieldfile.h"
+#include "framebuffer.h"
+#include "framewriter.h"
+#include "itercap.h"
+#include "palette.h"
+#include "perturbation.h"
+#include "poster.h"
+#include "renderfarm.h"
+#include "supersample.h"
+#include "threadpool.h"
+#include "tilecache.h"
+#include "tilerenderer.h"
+#include "viewport.h"
 
 const int SCREEN_WIDTH = 800;
 const int SCREEN_HEIGHT = 600;
 const int MAX_ITER = 1000;
+const double ZOOM_STEP = 0.8;
+const int TILE_CACHE_TILES = 4096;
+const int TILE_STORE_SLOTS = 16384;
+
+// Largest exponential map a zoom video may use, in pixels; each takes 12
+// bytes while the frames are made.
+const long long MAX_EXPMAP_PIXELS = 1LL << 27;
+
+// Buddhabrot samples between two progress reports.
+const long long BUDDHABROT_BATCH = 100000000;
+
+// Deepening doubles the cap until a doubling lets fewer than DEEPEN_STABLE
+// of the pixels escape, or the cap would pass DEEPEN_LIMIT.
+const double DEEPEN_STABLE = 1e-4;
+const int DEEPEN_LIMIT = 1 << 20;
+
+// Lowest cap the viewer's automatic cap goes down to.
+const int AUTO_CAP_MIN = 64;
+
+// A still view gets more samples ACCUMULATE_ROWS rows at a time, between
+// checks for input, whether accumulated or antialiased once. Once there is
+// nothing left to do, the viewer sleeps until an event or for IDLE_WAIT_MS.
+const int ACCUMULATE_ROWS = 32;
+const int IDLE_WAIT_MS = 100;
+
+// Color cycling turns the gradient once every CYCLE_PERIOD_MS, recoloring a
+// still frame every CYCLE_FRAME_MS.
+const int CYCLE_PERIOD_MS = 10000;
+const int CYCLE_FRAME_MS = 16;
+
+const Viewport DEFAULT_VIEW = { -2.5, -1.0, 3.5 / SCREEN_WIDTH, 2.0 / SCREEN_HEIGHT };
+
+// c of the Julia set used unless another one is given.
+const double JULIA_RE = -0.8;
+const double JULIA_IM = 0.156;
+
+// The plain escape-time loop, with every operation in Real: float, double,
+// DoubleDouble or FixedPoint.
+template <typename Real>
+int mandelbrot(const Real& cr, const Real& ci, int maxIter = MAX_ITER) {
+    Real zr = 0.0, zi = 0.0;
+    int iter = 0;
+    while (iter < maxIter) {
+        Real zr2 = square(zr);
+        Real zi2 = square(zi);
+        if (zr2 + zi2 > 4.0) {
+            break;
+        }
+        Real zri = zr * zi;
+        zi = zri + zri + ci;
+        zr = zr2 - zi2 + cr;
+        iter++;
+    }
+    return iter;
+}
+
+// c of pixel (x, y) in a view whose top-left corner (re0, im0) is held in Real.
+template <typename Real>
+void pixelToComplex(const Real& re0, const Real& im0, double dre, double dim, int x, int y, Real& cr, Real& ci) {
+    cr = re0 + Real(x * dre);
+    ci = im0 + Real(y * dim);
+}
+
+template <typename Real>
+void pixelToComplex(int x, int y, Real& cr, Real& ci) {
+    pixelToComplex<Real>(DEFAULT_VIEW.re0, DEFAULT_VIEW.im0, DEFAULT_VIEW.dre, DEFAULT_VIEW.dim, x, y, cr, ci);
+}
+
+// The whole set of each formula.
+Viewport formulaView(Formula formula) {
+    switch (formula) {
+        case FORMULA_JULIA: return centeredViewport(0.0, 0.0, 4.0, SCREEN_WIDTH, SCREEN_HEIGHT);
+        case FORMULA_MULTIBROT3: return centeredViewport(0.0, 0.0, 3.2, SCREEN_WIDTH, SCREEN_HEIGHT);
+        case FORMULA_MULTIBROT4: return centeredViewport(-0.15, 0.0, 3.2, SCREEN_WIDTH, SCREEN_HEIGHT);
+        case FORMULA_BURNING_SHIP: return centeredViewport(-0.4, -0.5, 3.6, SCREEN_WIDTH, SCREEN_HEIGHT);
+        default: return DEFAULT_VIEW;
+    }
+}
+
+bool parseFormula(const std::string& name, Formula& formula) {
+    for (Formula candidate : ALL_FORMULAS) {
+        if (name == formulaName(candidate)) {
+            formula = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Largest |re| or |im| in the view, which sets how fine a precision must be.
+double viewMagnitude(const Viewport& view, int width, int height) {
+    return std::max(std::max(std::fabs(view.re0), std::fabs(view.re0 + width * view.dre)),
+                    std::max(std::fabs(view.im0), std::fabs(view.im0 + height * view.dim)));
+}
+
+Precision viewPrecision(const Viewport& view, int width, int height) {
+    return choosePrecision(std::min(view.dre, view.dim), viewMagnitude(view, width, height));
+}
+
+// Julia kernels get the set of JULIA_RE + i JULIA_IM.
+long long computeFrame(EscapeSpanFn span, const Viewport& view, int maxIter, bool shortcuts,
+                       std::vector<int>& iters, EscapeStats* statsOut = nullptr,
+                       std::vector<EscapeOrbit>* orbits = nullptr) {
+    EscapeStats stats;
+    for (int y = 0; y < SCREEN_HEIGHT; ++y) {
+        EscapeRow row = { view.re0, view.dre, view.im0 + y * view.dim, 0, 1, SCREEN_WIDTH,
+                          maxIter, shortcuts, &iters[y * SCREEN_WIDTH], nullptr,
+                          orbits ? &(*orbits)[y * SCREEN_WIDTH] : nullptr, JULIA_RE, JULIA_IM };
+        span(row, stats);
+    }
+    if (statsOut) {
+        *statsOut = stats;
+    }
+    return stats.iterations;
+}
 
-int mandelbrot(std::complex<double> c) {
-    std::complex<double> z = 0;
+// The plain escape-time loop of formula at a pixel, written out by hand
+// rather than through the map policies so that it checks them. Real is float
+// or double, and the pixel is formed in double and rounded to it, as the
+// kernels do. The operations are in the order the maps use, so the counts
+// match exactly.
+template <typename Real>
+int referenceEscape(Formula formula, double pixelRe, double pixelIm, int maxIter) {
+    bool julia = formula == FORMULA_JULIA;
+    Real cr = julia ? (Real)JULIA_RE : (Real)pixelRe;
+    Real ci = julia ? (Real)JULIA_IM : (Real)pixelIm;
+    Real zr = julia ? (Real)pixelRe : (Real)0;
+    Real zi = julia ? (Real)pixelIm : (Real)0;
     int iter = 0;
-    while (std::abs(z) <= 2 && iter < MAX_ITER) {
-        z = z * z + c;
+    while (iter < maxIter) {
+        Real zr2 = zr * zr;
+        Real zi2 = zi * zi;
+        if (zr2 + zi2 > 4) {
+            break;
+        }
+        Real nextR, nextI;
+        if (formula == FORMULA_MULTIBROT3) {
+            Real squareR = zr2 - zi2, squareI = 2 * zr * zi;
+            nextR = squareR * zr - squareI * zi;
+            nextI = squareR * zi + squareI * zr;
+        } else if (formula == FORMULA_MULTIBROT4) {
+            Real squareR = zr2 - zi2, squareI = 2 * zr * zi;
+            nextR = squareR * squareR - squareI * squareI;
+            nextI = 2 * squareR * squareI;
+        } else if (formula == FORMULA_BURNING_SHIP) {
+            nextR = zr2 - zi2;
+            nextI = std::fabs(2 * zr * zi);
+        } else {
+            nextR = zr2 - zi2;
+            nextI = 2 * zr * zi;
+        }
+        zr = nextR + cr;
+        zi = nextI + ci;
         iter++;
     }
     return iter;
 }
 
-std::complex<double> pixelToComplex(int x, int y) {
-    double real = (double)x / SCREEN_WIDTH * (3.5) - 2.5;
-    double imag = (double)y / SCREEN_HEIGHT * (2.0) - 1.0;
-    return std::complex<double>(real, imag);
+// referenceEscape over a SCREEN_WIDTH x SCREEN_HEIGHT view, with the pixels
+// placed as computeFrame places them.
+template <typename Real>
+void computeReferenceFrame(Formula formula, const Viewport& view, int maxIter, std::vector<int>& iters) {
+    for (int y = 0; y < SCREEN_HEIGHT; ++y) {
+        double im = view.im0 + y * view.dim;
+        for (int x = 0; x < SCREEN_WIDTH; ++x) {
+            iters[y * SCREEN_WIDTH + x] = referenceEscape<Real>(formula, view.re0 + x * view.dre, im, maxIter);
+        }
+    }
 }
 
-void getColor(int iter, int& r, int& g, int& b) {
-    if (iter == MAX_ITER) {
-        r = 0;
-        g = 0;
-        b = 0;
+long long computeFrameReference(std::vector<int>& iters) {
+    long long total = 0;
+    for (int y = 0; y < SCREEN_HEIGHT; ++y) {
+        for (int x = 0; x < SCREEN_WIDTH; ++x) {
+            double cr, ci;
+            pixelToComplex(x, y, cr, ci);
+            int iter = mandelbrot(cr, ci);
+            iters[y * SCREEN_WIDTH + x] = iter;
+            total += iter;
+        }
+    }
+    return total;
+}
+
+void reportThroughput(const char* name, long long iterations, Uint64 start, Uint64 end) {
+    double seconds = (double)(end - start) / SDL_GetPerformanceFrequency();
+    std::cout << name << ": " << seconds * 1000.0 << " ms, "
+              << iterations / seconds / 1e9 << " Giters/s" << std::endl;
+}
+
+int countMismatches(const std::vector<int>& a, const std::vector<int>& b) {
+    int mismatched = 0;
+    for (size_t i = 0; i < a.size(); ++i) {
+        mismatched += a[i] != b[i];
+    }
+    return mismatched;
+}
+
+long long countUnescaped(const std::vector<int>& iters, int maxIter) {
+    return std::count(iters.begin(), iters.end(), maxIter);
+}
+
+void reportSupersampling(const SupersampleStats& stats, Uint64 start, int pixels) {
+    double ms = (double)(SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+    std::cout << "  antialiased " << 100.0 * stats.pixels / pixels << "% of the pixels with " << stats.samples
+              << " samples in " << ms << " ms" << std::endl;
+}
+
+void reportAccumulation(int samples, long long iterations, Uint64 start) {
+    double seconds = (double)(SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+    std::cout << "  accumulated " << samples << " samples per pixel in " << seconds * 1000.0 << " ms, "
+              << iterations / seconds / 1e9 << " Giters/s" << std::endl;
+}
+
+// Times the reference loop (a hand-written z^2 + c) and every kernel this CPU
+// can run on the default view, checking that they all agree with the
+// reference, then the widest kernel of every formula.
+int runBenchmark() {
+    std::vector<int> reference(SCREEN_WIDTH * SCREEN_HEIGHT);
+    std::vector<int> iters(SCREEN_WIDTH * SCREEN_HEIGHT);
+
+    Uint64 start = SDL_GetPerformanceCounter();
+    long long total = computeFrameReference(reference);
+    reportThroughput("reference", total, start, SDL_GetPerformanceCounter());
+
+    int mismatches = 0;
+    for (const EscapeKernel& kernel : availableEscapeKernels()) {
+        for (int shortcuts = 0; shortcuts <= 1; ++shortcuts) {
+            std::string name = std::string(kernel.name) + (shortcuts ? " + shortcuts" : "");
+            start = SDL_GetPerformanceCounter();
+            total = computeFrame(kernel.span, DEFAULT_VIEW, MAX_ITER, shortcuts, iters);
+            reportThroughput(name.c_str(), total, start, SDL_GetPerformanceCounter());
+            if (iters != reference) {
+                std::cout << name << " does not match the reference!" << std::endl;
+                mismatches++;
+            }
+        }
+    }
+
+    for (Formula formula : ALL_FORMULAS) {
+        EscapeKernel widest = selectEscapeKernel(PRECISION_DOUBLE, formula);
+        std::string name = std::string(formulaName(formula)) + ", " + widest.name + " + shortcuts";
+        start = SDL_GetPerformanceCounter();
+        total = computeFrame(widest.span, formulaView(formula), MAX_ITER, true, iters);
+        reportThroughput(name.c_str(), total, start, SDL_GetPerformanceCounter());
+    }
+
+    ThreadPool pool;
+    EscapeKernel kernel = selectEscapeKernel();
+    TileRenderer tiles(pool, kernel.span, SCREEN_WIDTH, SCREEN_HEIGHT, 1);
+    start = SDL_GetPerformanceCounter();
+    tiles.start(DEFAULT_VIEW, MAX_ITER);
+    tiles.wait();
+    std::string name = std::string(kernel.name) + " tiles x " + std::to_string(pool.size()) + " threads";
+    reportThroughput(name.c_str(), tiles.stats().iterations, start, SDL_GetPerformanceCounter());
+    if (tiles.iterations() != reference) {
+        std::cout << name << " does not match the reference!" << std::endl;
+        mismatches++;
+    }
+
+    // Two moved frames, the second after the cap came down: it starts from
+    // the first one's counts, which must not reach past the new cap while
+    // it is colored, and ends up as if computed at that cap from scratch.
+    const int LOWER_CAP = 64;
+    Warp moved = { 1.0, 3.0, -2.0 };
+    Viewport pannedOnce = panViewport(DEFAULT_VIEW, -3, 2), pannedTwice = panViewport(pannedOnce, -3, 2);
+    tiles.start(pannedOnce, MAX_ITER, &moved);
+    tiles.wait();
+    tiles.start(pannedTwice, LOWER_CAP, &moved);
+    int pastCap = 0;
+    for (int count : tiles.iterations()) {
+        pastCap += count > LOWER_CAP;
+    }
+    Palette lowered;
+    lowered.setMaxIter(LOWER_CAP);
+    std::vector<Uint32> colors(SCREEN_WIDTH * SCREEN_HEIGHT);
+    lowered.equalize(pool, tiles.iterations().data(), SCREEN_WIDTH * SCREEN_HEIGHT);
+    lowered.colorFrame(pool, COLOR_HISTOGRAM, tiles.iterations().data(), nullptr, SCREEN_WIDTH, SCREEN_HEIGHT,
+                       colors.data(), SCREEN_WIDTH);
+    tiles.wait();
+    computeFrame(kernel.span, pannedTwice, LOWER_CAP, true, iters);
+    if (pastCap > 0 || tiles.iterations() != iters) {
+        std::cout << "moved tiles after lowering the cap do not match the reference (" << pastCap
+                  << " pixels past it)!" << std::endl;
+        mismatches++;
+    }
+
+    // Subdivision may fill over detail its rectangles' borders miss, so it is
+    // reported rather than required to match.
+    TileRenderer subdivided(pool, kernel.span, SCREEN_WIDTH, SCREEN_HEIGHT);
+    subdivided.setSubdivision(true);
+    start = SDL_GetPerformanceCounter();
+    subdivided.start(DEFAULT_VIEW, MAX_ITER);
+    subdivided.wait();
+    name = std::string(kernel.name) + " subdivision x " + std::to_string(pool.size()) + " threads";
+    reportThroughput(name.c_str(), subdivided.stats().iterations, start, SDL_GetPerformanceCounter());
+    std::cout << "  computed " << 100.0 * subdivided.samples() / (SCREEN_WIDTH * SCREEN_HEIGHT) << "% of the pixels, "
+              << countMismatches(subdivided.iterations(), reference) << " differ from the reference" << std::endl;
+
+    // Coloring a full HD frame, from counts that are already computed.
+    const int HD_WIDTH = 1920, HD_HEIGHT = 1080;
+    TileRenderer hd(pool, kernel.span, HD_WIDTH, HD_HEIGHT, 1);
+    hd.setSmooth(true);
+    hd.start(centeredViewport(-0.75, 0.0, 3.5, HD_WIDTH, HD_HEIGHT), MAX_ITER);
+    hd.wait();
+    Palette palette;
+    palette.setMaxIter(MAX_ITER);
+    std::vector<Uint32> pixels(HD_WIDTH * HD_HEIGHT);
+    const int COLOR_RUNS = 9;
+    auto timeColoring = [&](ColorMode mode, const std::string& label) {
+        std::vector<double> times;
+        for (int run = 0; run < COLOR_RUNS; ++run) {
+            start = SDL_GetPerformanceCounter();
+            if (mode == COLOR_HISTOGRAM) {
+                palette.equalize(pool, hd.iterations().data(), HD_WIDTH * HD_HEIGHT);
+            }
+            palette.colorFrame(pool, mode, hd.iterations().data(), hd.smoothIterations().data(), HD_WIDTH, HD_HEIGHT,
+                               pixels.data(), HD_WIDTH);
+            times.push_back((double)(SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency());
+        }
+        std::sort(times.begin(), times.end());
+        std::cout << label << " coloring " << HD_WIDTH << "x" << HD_HEIGHT << " x " << pool.size()
+                  << " threads: median " << times[COLOR_RUNS / 2] << " ms" << std::endl;
+    };
+    for (ColorMode mode : { COLOR_BANDED, COLOR_SMOOTH, COLOR_HISTOGRAM }) {
+        timeColoring(mode, colorModeName(mode));
+    }
+
+    // The histogram's bins grow with the cap, not the frame.
+    palette.setMaxIter(DEEPEN_LIMIT);
+    timeColoring(COLOR_HISTOGRAM, "histogram (cap " + std::to_string(DEEPEN_LIMIT) + ")");
+    return mismatches == 0 ? 0 : 1;
+}
+
+struct NamedView {
+    const char* name;
+    Viewport view;
+};
+
+std::vector<NamedView> shortcutTestViews() {
+    return {
+        { "full set", DEFAULT_VIEW },
+        { "main body", centeredViewport(-0.4, 0.0, 1.6, SCREEN_WIDTH, SCREEN_HEIGHT) },
+        { "seahorse valley", centeredViewport(-0.745, 0.1, 0.02, SCREEN_WIDTH, SCREEN_HEIGHT) },
+        { "period-3 bulb", centeredViewport(-0.122, 0.745, 0.2, SCREEN_WIDTH, SCREEN_HEIGHT) },
+        { "cardioid cusp", centeredViewport(0.25, 0.0, 0.01, SCREEN_WIDTH, SCREEN_HEIGHT) },
+    };
+}
+
+// Prints how many iterations the cardioid/bulb test and cycle detection save.
+int runShortcutStats() {
+    EscapeKernel kernel = selectEscapeKernel();
+    std::vector<int> iters(SCREEN_WIDTH * SCREEN_HEIGHT);
+    for (const NamedView& test : shortcutTestViews()) {
+        EscapeStats stats;
+        long long bruteForce = computeFrame(kernel.span, test.view, MAX_ITER, false, iters);
+        computeFrame(kernel.span, test.view, MAX_ITER, true, iters, &stats);
+        std::cout << test.name << ": " << bruteForce << " iterations brute force, "
+                  << stats.iterations << " with shortcuts" << std::endl
+                  << "  cardioid: " << stats.cardioidPixels << " pixels, " << stats.cardioidSaved << " saved" << std::endl
+                  << "  bulb: " << stats.bulbPixels << " pixels, " << stats.bulbSaved << " saved" << std::endl
+                  << "  periodicity: " << stats.periodicPixels << " pixels, " << stats.periodicSaved << " saved" << std::endl;
+    }
+    return 0;
+}
+
+// Checks that every kernel, float and double, gives pixel-exact results with
+// the shortcuts on, against the hand-written loop of its formula
+// (referenceEscape) in the same precision, over views that exercise them.
+// Each kernel also carries its orbits from one cap to the next, which has to
+// give the same counts as starting over.
+int runShortcutVerify() {
+    const int caps[] = { 1, 2, 37, 1000, 1024 };
+    std::vector<int> reference(SCREEN_WIDTH * SCREEN_HEIGHT);
+    std::vector<int> iters(SCREEN_WIDTH * SCREEN_HEIGHT);
+    int failures = 0;
+    for (Formula formula : ALL_FORMULAS) {
+        std::vector<NamedView> views = shortcutTestViews();
+        if (formula != FORMULA_MANDELBROT) {
+            views = { { formulaName(formula), formulaView(formula) } };
+        }
+        for (Precision precision : { PRECISION_FLOAT, PRECISION_DOUBLE }) {
+            std::vector<EscapeKernel> kernels = availableEscapeKernels(precision, formula);
+            for (const NamedView& test : views) {
+                std::vector<std::vector<int>> continued(kernels.size(), std::vector<int>(SCREEN_WIDTH * SCREEN_HEIGHT));
+                std::vector<std::vector<EscapeOrbit>> orbits(kernels.size(),
+                                                             std::vector<EscapeOrbit>(SCREEN_WIDTH * SCREEN_HEIGHT));
+                for (int maxIter : caps) {
+                    if (precision == PRECISION_FLOAT) {
+                        computeReferenceFrame<float>(formula, test.view, maxIter, reference);
+                    } else {
+                        computeReferenceFrame<double>(formula, test.view, maxIter, reference);
+                    }
+                    for (size_t k = 0; k < kernels.size(); ++k) {
+                        std::string name = std::string(kernels[k].name) + " " + precisionName(precision);
+                        computeFrame(kernels[k].span, test.view, maxIter, true, iters);
+                        int mismatched = countMismatches(iters, reference);
+                        if (mismatched > 0) {
+                            std::cout << "FAIL " << name << ", " << test.name << ", max_iter " << maxIter << ": "
+                                      << mismatched << " pixels differ" << std::endl;
+                            failures++;
+                        }
+                        computeFrame(kernels[k].span, test.view, maxIter, true, continued[k], nullptr, &orbits[k]);
+                        mismatched = countMismatches(continued[k], reference);
+                        if (mismatched > 0) {
+                            std::cout << "FAIL " << name << ", " << test.name << ", continued to max_iter " << maxIter
+                                      << ": " << mismatched << " pixels differ" << std::endl;
+                            failures++;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    std::cout << (failures == 0 ? "All kernels match the reference loops." : "Shortcut verification failed.") << std::endl;
+    return failures == 0 ? 0 : 1;
+}
+
+// Shows what each precision costs and where it stops resolving pixels. The
+// float and double kernels are compared against the double reference on the
+// default view. A 1e-14-pixel view compares plain double and perturbation
+// against the reference loop run in double-double.
+int runPrecisionReport() {
+    std::vector<int> reference(SCREEN_WIDTH * SCREEN_HEIGHT);
+    std::vector<int> iters(SCREEN_WIDTH * SCREEN_HEIGHT);
+    computeFrame(escapeSpanScalar, DEFAULT_VIEW, MAX_ITER, false, reference);
+    std::cout << "Default view, chosen precision: "
+              << precisionName(viewPrecision(DEFAULT_VIEW, SCREEN_WIDTH, SCREEN_HEIGHT)) << std::endl;
+    for (Precision precision : { PRECISION_FLOAT, PRECISION_DOUBLE }) {
+        EscapeKernel kernel = selectEscapeKernel(precision);
+        std::string name = std::string(kernel.name) + " " + precisionName(precision);
+        Uint64 start = SDL_GetPerformanceCounter();
+        long long total = computeFrame(kernel.span, DEFAULT_VIEW, MAX_ITER, true, iters);
+        reportThroughput(name.c_str(), total, start, SDL_GetPerformanceCounter());
+        std::cout << "  " << countMismatches(iters, reference) << " pixels differ from double" << std::endl;
+    }
+
+    const int WIDTH = 200, HEIGHT = 150, DEEP_ITER = 4000;
+    const double PIXEL = 1e-14;
+    int limbs = BigFixed::limbsFor(PIXEL);
+    DeepViewport deep = { BigFixed(limbs), BigFixed(limbs), PIXEL, PIXEL, WIDTH, HEIGHT };
+    BigFixed::parse("-0.743643887037158704752191506114774", limbs, deep.centerRe);
+    BigFixed::parse("0.131825904205311970493132056385139", limbs, deep.centerIm);
+    DoubleDouble re0 = toDoubleDouble(deep.centerRe) - DoubleDouble(WIDTH / 2 * PIXEL);
+    DoubleDouble im0 = toDoubleDouble(deep.centerIm) - DoubleDouble(HEIGHT / 2 * PIXEL);
+    std::cout << "1e-14 pixels, chosen precision: "
+              << precisionName(choosePrecision(PIXEL, std::fabs(deep.centerRe.toDouble()))) << std::endl;
+
+    std::vector<int> exact(WIDTH * HEIGHT), plain(WIDTH * HEIGHT), perturbed(WIDTH * HEIGHT);
+    long long total = 0;
+    Uint64 start = SDL_GetPerformanceCounter();
+    for (int y = 0; y < HEIGHT; ++y) {
+        for (int x = 0; x < WIDTH; ++x) {
+            DoubleDouble cr, ci;
+            pixelToComplex(re0, im0, PIXEL, PIXEL, x, y, cr, ci);
+            exact[y * WIDTH + x] = mandelbrot(cr, ci, DEEP_ITER);
+            total += exact[y * WIDTH + x];
+        }
+    }
+    reportThroughput("double-double", total, start, SDL_GetPerformanceCounter());
+
+    total = 0;
+    start = SDL_GetPerformanceCounter();
+    for (int y = 0; y < HEIGHT; ++y) {
+        for (int x = 0; x < WIDTH; ++x) {
+            double cr, ci;
+            pixelToComplex(toDouble(re0), toDouble(im0), PIXEL, PIXEL, x, y, cr, ci);
+            plain[y * WIDTH + x] = mandelbrot(cr, ci, DEEP_ITER);
+            total += plain[y * WIDTH + x];
+        }
+    }
+    reportThroughput("double", total, start, SDL_GetPerformanceCounter());
+    std::cout << "  " << countMismatches(plain, exact) << " pixels differ from double-double" << std::endl;
+
+    EscapeStats stats;
+    start = SDL_GetPerformanceCounter();
+    PerturbationRows rows = makePerturbationRows(deep, DEEP_ITER);
+    for (int y = 0; y < HEIGHT; ++y) {
+        rows(y, 0, 1, WIDTH, &perturbed[y * WIDTH], nullptr, stats);
+    }
+    reportThroughput("perturbation", stats.iterations, start, SDL_GetPerformanceCounter());
+    std::cout << "  " << countMismatches(perturbed, exact) << " pixels differ from double-double" << std::endl;
+    return 0;
+}
+
+// Times the orbit of (re, im) in FixedPoint<Limbs> and in a BigFixed of
+// about as many bits, and reports for how many iterations they agree.
+template <int Limbs>
+void reportFixedPointOrbit(const char* re, const char* im, int maxIter) {
+    int limbs = FixedPoint<Limbs>::FRACTION_BITS / 32 + 1;
+    BigFixed cr(limbs), ci(limbs);
+    BigFixed::parse(re, limbs, cr);
+    BigFixed::parse(im, limbs, ci);
+    std::string bits = std::to_string(64 * Limbs) + " bits";
+    Uint64 start = SDL_GetPerformanceCounter();
+    ReferenceOrbit fixed = computeReferenceOrbit(toFixedPoint<Limbs>(cr), toFixedPoint<Limbs>(ci), maxIter);
+    Uint64 end = SDL_GetPerformanceCounter();
+    reportThroughput((bits + ", FixedPoint").c_str(), (long long)fixed.zr.size() - 1, start, end);
+    double fixedSeconds = (double)(end - start) / SDL_GetPerformanceFrequency();
+    start = SDL_GetPerformanceCounter();
+    ReferenceOrbit big = computeReferenceOrbit(cr, ci, maxIter);
+    end = SDL_GetPerformanceCounter();
+    reportThroughput((bits + ", BigFixed").c_str(), (long long)big.zr.size() - 1, start, end);
+    double bigSeconds = (double)(end - start) / SDL_GetPerformanceFrequency();
+    size_t agree = 0;
+    while (agree < std::min(fixed.zr.size(), big.zr.size()) && std::fabs(fixed.zr[agree] - big.zr[agree]) < 1e-9 &&
+           std::fabs(fixed.zi[agree] - big.zi[agree]) < 1e-9) {
+        agree++;
+    }
+    std::cout << "  " << bigSeconds / fixedSeconds << "x faster, orbits agree for " << agree << " of "
+              << fixed.zr.size() << " points" << std::endl;
+}
+
+// Benchmarks fixed-point reference orbits per limb count, and renders a
+// 1e-30-pixel view with mandelbrot() in FixedPoint to check perturbation
+// against it.
+int runFixedPointReport() {
+    const char* RE = "-0.743643887037158704752191506114774";
+    const char* IM = "0.131825904205311970493132056385139";
+    const int ORBIT_ITER = 20000;
+    std::cout << "Reference orbit of " << RE << " " << IM << ", " << ORBIT_ITER << " iterations" << std::endl;
+    reportFixedPointOrbit<2>(RE, IM, ORBIT_ITER);
+    reportFixedPointOrbit<4>(RE, IM, ORBIT_ITER);
+    reportFixedPointOrbit<8>(RE, IM, ORBIT_ITER);
+    reportFixedPointOrbit<16>(RE, IM, ORBIT_ITER);
+
+    typedef FixedPoint<3> Fixed;
+    const int WIDTH = 64, HEIGHT = 48, DEEP_ITER = 5000;
+    const double PIXEL = 1e-30;
+    int limbs = BigFixed::limbsFor(PIXEL);
+    DeepViewport deep = { BigFixed(limbs), BigFixed(limbs), PIXEL, PIXEL, WIDTH, HEIGHT };
+    BigFixed::parse(RE, limbs, deep.centerRe);
+    BigFixed::parse(IM, limbs, deep.centerIm);
+    Fixed re0 = toFixedPoint<3>(deep.centerRe) - Fixed(WIDTH / 2 * PIXEL);
+    Fixed im0 = toFixedPoint<3>(deep.centerIm) - Fixed(HEIGHT / 2 * PIXEL);
+    std::vector<int> exact(WIDTH * HEIGHT), perturbed(WIDTH * HEIGHT);
+    long long total = 0;
+    Uint64 start = SDL_GetPerformanceCounter();
+    for (int y = 0; y < HEIGHT; ++y) {
+        for (int x = 0; x < WIDTH; ++x) {
+            Fixed cr, ci;
+            pixelToComplex(re0, im0, PIXEL, PIXEL, x, y, cr, ci);
+            exact[y * WIDTH + x] = mandelbrot(cr, ci, DEEP_ITER);
+            total += exact[y * WIDTH + x];
+        }
+    }
+    reportThroughput("1e-30 pixels, mandelbrot() in 192-bit FixedPoint", total, start, SDL_GetPerformanceCounter());
+
+    EscapeStats stats;
+    start = SDL_GetPerformanceCounter();
+    PerturbationRows rows = makePerturbationRows(deep, DEEP_ITER);
+    for (int y = 0; y < HEIGHT; ++y) {
+        rows(y, 0, 1, WIDTH, &perturbed[y * WIDTH], nullptr, stats);
+    }
+    reportThroughput("perturbation", stats.iterations, start, SDL_GetPerformanceCounter());
+    std::cout << "  " << countMismatches(perturbed, exact) << " pixels differ from fixed point" << std::endl;
+    return 0;
+}
+
+// A view of the benchmark suite, rendered at a fixed size and cap like the
+// viewer would: shallow views by the widest kernel in the precision they
+// need, views with pixels below DEEP_ZOOM_PIXEL_SIZE by perturbation. The
+// deep view is centred on c = i, where filaments branch at every depth.
+struct BenchView {
+    const char* name;
+    const char* centerRe;
+    const char* centerIm;
+    double viewWidth;
+    int width;
+    int height;
+    int maxIter;
+};
+
+const BenchView BENCH_SUITE[] = {
+    { "full set", "-0.75", "0", 3.5, 800, 600, 1000 },
+    { "seahorse valley", "-0.745", "0.1", 0.02, 800, 600, 2000 },
+    { "interior heavy", "-0.122", "0.745", 0.2, 800, 600, 5000 },
+    { "exterior heavy", "0.75", "0.5", 1.0, 800, 600, 1000 },
+    { "deep filament", "0", "1", 4e-28, 400, 300, 5000 },
+};
+const int BENCH_WARMUP = 1;
+const int BENCH_REPETITIONS = 7;
+
+struct BenchResult {
+    std::string name;
+    std::string path;
+    int width;
+    int height;
+    int maxIter;
+    double medianMs;
+    double p95Ms;
+    long long iterations;
+    Uint64 checksum;
+};
+
+// FNV-1a over the bytes of the counts.
+Uint64 checksumIterations(const std::vector<int>& iters) {
+    Uint64 hash = 14695981039346656037ULL;
+    const unsigned char* bytes = (const unsigned char*)iters.data();
+    for (size_t i = 0; i < iters.size() * sizeof(int); ++i) {
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Renders a view BENCH_WARMUP times untimed, then BENCH_REPETITIONS times
+// timed. Every repetition has to give the same counts.
+bool runBenchView(ThreadPool& pool, const BenchView& bench, BenchResult& result) {
+    double pixelSize = bench.viewWidth / bench.width;
+    int limbs = BigFixed::limbsFor(pixelSize);
+    DeepViewport view = { BigFixed(limbs), BigFixed(limbs), pixelSize, pixelSize, bench.width, bench.height };
+    BigFixed::parse(bench.centerRe, limbs, view.centerRe);
+    BigFixed::parse(bench.centerIm, limbs, view.centerIm);
+    bool deep = pixelSize < DEEP_ZOOM_PIXEL_SIZE;
+    Precision precision = std::min(viewPrecision(toViewport(view), bench.width, bench.height), PRECISION_DOUBLE);
+    EscapeKernel kernel = selectEscapeKernel(precision);
+    result = { bench.name, deep ? std::string("perturbation") : std::string(kernel.name) + " " + precisionName(precision),
+               bench.width, bench.height, bench.maxIter, 0.0, 0.0, 0, 0 };
+
+    TileRenderer tiles(pool, kernel.span, bench.width, bench.height, 1);
+    std::vector<double> times;
+    for (int run = 0; run < BENCH_WARMUP + BENCH_REPETITIONS; ++run) {
+        Uint64 start = SDL_GetPerformanceCounter();
+        if (deep) {
+            tiles.start(makePerturbationRows(view, bench.maxIter), bench.maxIter);
+        } else {
+            tiles.start(toViewport(view), bench.maxIter);
+        }
+        tiles.wait();
+        double ms = (double)(SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+        Uint64 checksum = checksumIterations(tiles.iterations());
+        if (run > 0 && checksum != result.checksum) {
+            std::cout << bench.name << ": counts changed between runs" << std::endl;
+            return false;
+        }
+        result.checksum = checksum;
+        result.iterations = tiles.stats().iterations;
+        if (run >= BENCH_WARMUP) {
+            times.push_back(ms);
+        }
+    }
+    std::sort(times.begin(), times.end());
+    result.medianMs = times[times.size() / 2];
+    result.p95Ms = times[std::min(times.size() - 1, (size_t)std::ceil(0.95 * times.size()) - 1)];
+    return true;
+}
+
+std::string checksumText(Uint64 checksum) {
+    char text[17];
+    std::snprintf(text, sizeof(text), "%016llx", (unsigned long long)checksum);
+    return text;
+}
+
+// One view per line, so baselines can be read back line by line.
+std::string benchJson(const std::string& kernel, int threads, const std::vector<BenchResult>& results) {
+    std::ostringstream json;
+    json << "{\n  \"kernel\": \"" << kernel << "\",\n  \"threads\": " << threads << ",\n  \"warmup\": " << BENCH_WARMUP
+         << ",\n  \"repetitions\": " << BENCH_REPETITIONS << ",\n  \"views\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchResult& r = results[i];
+        double seconds = r.medianMs / 1000.0;
+        json << "    { \"name\": \"" << r.name << "\", \"path\": \"" << r.path << "\", \"width\": " << r.width
+             << ", \"height\": " << r.height << ", \"max_iter\": " << r.maxIter << ", \"median_ms\": " << r.medianMs
+             << ", \"p95_ms\": " << r.p95Ms << ", \"pixels_per_s\": " << (double)r.width * r.height / seconds
+             << ", \"iterations_per_s\": " << r.iterations / seconds << ", \"iterations\": " << r.iterations
+             << ", \"checksum\": \"" << checksumText(r.checksum) << "\" }" << (i + 1 < results.size() ? "," : "")
+             << "\n";
+    }
+    json << "  ]\n}\n";
+    return json.str();
+}
+
+// The text after "key": on a line written by benchJson, without quotes.
+std::string jsonField(const std::string& line, const std::string& key) {
+    size_t at = line.find("\"" + key + "\": ");
+    if (at == std::string::npos) {
+        return "";
+    }
+    at += key.size() + 4;
+    if (line[at] == '"') {
+        return line.substr(at + 1, line.find('"', at + 1) - at - 1);
+    }
+    return line.substr(at, line.find_first_of(",}", at) - at);
+}
+
+// Compares results with a file written by an earlier run: counts must be
+// unchanged, and the median times are compared.
+bool compareBenchBaseline(const std::string& path, const std::vector<BenchResult>& results) {
+    std::ifstream file(path);
+    if (!file) {
+        std::cout << "Could not open " << path << std::endl;
+        return false;
+    }
+    bool same = true;
+    std::string line;
+    while (std::getline(file, line)) {
+        std::string name = jsonField(line, "name");
+        for (const BenchResult& r : results) {
+            if (name != r.name) {
+                continue;
+            }
+            if (jsonField(line, "checksum") != checksumText(r.checksum)) {
+                std::cout << r.name << ": counts differ from " << path << "!" << std::endl;
+                same = false;
+            }
+            double before = std::atof(jsonField(line, "median_ms").c_str());
+            std::cout << r.name << ": " << before << " ms -> " << r.medianMs << " ms, speedup " << before / r.medianMs
+                      << "x" << std::endl;
+        }
+    }
+    return same;
+}
+
+// Times the fixed suite of views and writes the results as JSON, to
+// jsonPath if it is given and to the console otherwise. With a baseline
+// from an earlier run, fails if any view's counts changed.
+int runBenchSuite(const std::string& jsonPath, const std::string& baselinePath) {
+    ThreadPool pool;
+    EscapeKernel widest = selectEscapeKernel();
+    std::vector<BenchResult> results;
+    for (const BenchView& bench : BENCH_SUITE) {
+        BenchResult result;
+        if (!runBenchView(pool, bench, result)) {
+            return 1;
+        }
+        std::cout << result.name << " (" << result.path << "): median " << result.medianMs << " ms, p95 "
+                  << result.p95Ms << " ms, " << result.iterations / (result.medianMs / 1000.0) / 1e9
+                  << " Giters/s, checksum " << checksumText(result.checksum) << std::endl;
+        results.push_back(result);
+    }
+    std::string json = benchJson(widest.name, pool.size(), results);
+    if (jsonPath.empty()) {
+        std::cout << json;
     } else {
-        double t = (double)iter / MAX_ITER;
-        r = (int)(9 * (1 - t) * t * t * t * 255);
-        g = (int)(15 * (1 - t) * (1 - t) * t * t * 255);
-        b = (int)(8.5 * (1 - t) * (1 - t) * (1 - t) * t * 255);
+        std::ofstream file(jsonPath);
+        file << json;
+        if (!file) {
+            std::cout << "Could not write " << jsonPath << std::endl;
+            return 1;
+        }
+    }
+    return baselinePath.empty() || compareBenchBaseline(baselinePath, results) ? 0 : 1;
+}
+
+// Mean difference per color channel between two images.
+double meanColorError(const std::vector<Uint32>& a, const std::vector<Uint32>& b) {
+    long long total = 0;
+    for (size_t i = 0; i < a.size(); ++i) {
+        for (int shift = 0; shift < 24; shift += 8) {
+            total += std::abs((int)((a[i] >> shift) & 0xFF) - (int)((b[i] >> shift) & 0xFF));
+        }
+    }
+    return (double)total / (a.size() * 3);
+}
+
+// Compares adaptive supersampling and accumulated samples with uniform
+// supersampling at the same grid on the test views under smooth coloring:
+// what each costs on top of the frame, and how far the plain, adaptive and
+// accumulated frames are from the uniform one.
+int runAntialiasReport() {
+    ThreadPool pool;
+    EscapeKernel kernel = selectEscapeKernel();
+    const int grid = Supersampler::DEFAULT_GRID;
+    std::cout << kernel.name << " x " << pool.size() << " threads, " << grid * grid << " samples per pixel" << std::endl;
+    Palette palette;
+    palette.setMaxIter(MAX_ITER);
+    for (const NamedView& test : shortcutTestViews()) {
+        TileRenderer tiles(pool, kernel.span, SCREEN_WIDTH, SCREEN_HEIGHT, 1);
+        tiles.setSmooth(true);
+        Uint64 start = SDL_GetPerformanceCounter();
+        tiles.start(test.view, MAX_ITER);
+        tiles.wait();
+        Uint64 frameTime = SDL_GetPerformanceCounter() - start;
+        const int* iters = tiles.iterations().data();
+        const float* smooth = tiles.smoothIterations().data();
+        std::vector<Uint32> plain(SCREEN_WIDTH * SCREEN_HEIGHT);
+        palette.colorFrame(pool, COLOR_SMOOTH, iters, smooth, SCREEN_WIDTH, SCREEN_HEIGHT, plain.data(), SCREEN_WIDTH);
+
+        Supersampler supersampler(pool, kernel.span);
+        std::vector<Uint32> adaptive = plain;
+        start = SDL_GetPerformanceCounter();
+        SupersampleStats stats = supersampler.apply(test.view, MAX_ITER, palette, COLOR_SMOOTH, iters, smooth,
+                                                    SCREEN_WIDTH, SCREEN_HEIGHT, adaptive.data(), SCREEN_WIDTH);
+        Uint64 adaptiveTime = SDL_GetPerformanceCounter() - start;
+        supersampler.setAdaptive(false);
+        std::vector<Uint32> uniform = plain;
+        start = SDL_GetPerformanceCounter();
+        supersampler.apply(test.view, MAX_ITER, palette, COLOR_SMOOTH, iters, smooth, SCREEN_WIDTH, SCREEN_HEIGHT,
+                           uniform.data(), SCREEN_WIDTH);
+        Uint64 uniformTime = SDL_GetPerformanceCounter() - start;
+
+        Accumulator accumulator(pool, kernel.span, SCREEN_WIDTH, SCREEN_HEIGHT);
+        std::vector<Uint32> accumulated = plain;
+        start = SDL_GetPerformanceCounter();
+        while (!accumulator.converged()) {
+            accumulator.accumulate(test.view, MAX_ITER, palette, COLOR_SMOOTH, SCREEN_HEIGHT, accumulated.data(),
+                                   SCREEN_WIDTH);
+        }
+        Uint64 accumulateTime = SDL_GetPerformanceCounter() - start;
+
+        double ms = 1000.0 / SDL_GetPerformanceFrequency();
+        std::cout << test.name << ": frame " << frameTime * ms << " ms" << std::endl
+                  << "  adaptive: " << adaptiveTime * ms << " ms more (" << (double)(frameTime + adaptiveTime) / frameTime
+                  << "x), " << 100.0 * stats.pixels / (SCREEN_WIDTH * SCREEN_HEIGHT) << "% of the pixels, "
+                  << (double)stats.samples / std::max(stats.pixels, 1LL) << " samples each" << std::endl
+                  << "  uniform: " << uniformTime * ms << " ms more (" << (double)(frameTime + uniformTime) / frameTime
+                  << "x)" << std::endl
+                  << "  accumulated: " << accumulateTime * ms << " ms more for " << accumulator.samplesPerPixel()
+                  << " samples per pixel" << std::endl
+                  << "  mean error against uniform: " << meanColorError(plain, uniform) << " without, "
+                  << meanColorError(adaptive, uniform) << " with adaptive, " << meanColorError(accumulated, uniform)
+                  << " accumulated" << std::endl;
+    }
+    return 0;
+}
+
+// One image for the headless renderer: the view centred on (centerRe,
+// centerIm), viewWidth wide, at width x height pixels. The centre is kept as
+// text so deep views keep all of its digits. With deepen set, maxIter is only
+// the starting cap and is doubled until the image stops changing. seedRe and
+// seedIm are c for Julia sets. antialias adds samples where the image needs
+// them (see Supersampler).
+struct RenderJob {
+    std::string centerRe;
+    std::string centerIm;
+    double viewWidth;
+    int width;
+    int height;
+    int maxIter;
+    std::string output;
+    ColorMode colorMode;
+    bool deepen;
+    bool antialias;
+    Formula formula;
+    double seedRe;
+    double seedIm;
+};
+
+bool parseColorMode(const std::string& name, ColorMode& mode) {
+    for (ColorMode candidate : { COLOR_BANDED, COLOR_SMOOTH, COLOR_HISTOGRAM }) {
+        if (name == colorModeName(candidate)) {
+            mode = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+// A Julia set as julia:<re>,<im>, or plain julia for the default one.
+bool parseJulia(const std::string& word, double& re, double& im) {
+    if (word == "julia") {
+        re = JULIA_RE;
+        im = JULIA_IM;
+        return true;
+    }
+    char end;
+    return std::sscanf(word.c_str(), "julia:%lf,%lf%c", &re, &im, &end) == 2;
+}
+
+// Seven fields, then optionally a color mode, "deepen", "antialias" and a
+// formula in any order.
+bool parseRenderJob(const std::vector<std::string>& fields, RenderJob& job) {
+    if (fields.size() < 7 || fields.size() > 11) {
+        return false;
+    }
+    job.colorMode = COLOR_BANDED;
+    job.deepen = false;
+    job.antialias = false;
+    job.formula = FORMULA_MANDELBROT;
+    job.seedRe = JULIA_RE;
+    job.seedIm = JULIA_IM;
+    bool colored = false, formulaGiven = false;
+    for (size_t i = 7; i < fields.size(); ++i) {
+        if (fields[i] == "deepen" && !job.deepen) {
+            job.deepen = true;
+        } else if (fields[i] == "antialias" && !job.antialias) {
+            job.antialias = true;
+        } else if (!colored && parseColorMode(fields[i], job.colorMode)) {
+            colored = true;
+        } else if (!formulaGiven && parseJulia(fields[i], job.seedRe, job.seedIm)) {
+            job.formula = FORMULA_JULIA;
+            formulaGiven = true;
+        } else if (!formulaGiven && parseFormula(fields[i], job.formula)) {
+            formulaGiven = true;
+        } else {
+            return false;
+        }
+    }
+    job.centerRe = fields[0];
+    job.centerIm = fields[1];
+    job.viewWidth = std::atof(fields[2].c_str());
+    job.width = std::atoi(fields[3].c_str());
+    job.height = std::atoi(fields[4].c_str());
+    job.maxIter = std::atoi(fields[5].c_str());
+    job.output = fields[6];
+    return job.viewWidth > 0.0 && job.width > 0 && job.height > 0 && job.maxIter > 0;
+}
+
+// Doubles the cap of the finished frame in tiles until a doubling lets fewer
+// than DEEPEN_STABLE of its pixels escape. Frames that cannot be continued
+// are recomputed by restart. Adds the iterations to iterations and returns
+// the final cap.
+int deepenUntilStable(TileRenderer& tiles, int maxIter, std::function<void(int maxIter)> restart,
+                      long long& iterations) {
+    long long running = countUnescaped(tiles.iterations(), maxIter);
+    while (maxIter <= DEEPEN_LIMIT / 2) {
+        maxIter *= 2;
+        if (!tiles.deepen(maxIter)) {
+            restart(maxIter);
+        }
+        tiles.wait();
+        iterations += tiles.stats().iterations;
+        long long now = countUnescaped(tiles.iterations(), maxIter);
+        bool stable = running - now < DEEPEN_STABLE * tiles.iterations().size();
+        running = now;
+        if (stable) {
+            break;
+        }
     }
+    return maxIter;
+}
+
+// The view of a job, with its centre parsed to as many limbs as its pixels
+// need.
+bool jobViewport(const RenderJob& job, DeepViewport& view) {
+    double pixelSize = job.viewWidth / job.width;
+    int limbs = BigFixed::limbsFor(pixelSize);
+    view = { BigFixed(limbs), BigFixed(limbs), pixelSize, pixelSize, job.width, job.height };
+    if (!BigFixed::parse(job.centerRe, limbs, view.centerRe) || !BigFixed::parse(job.centerIm, limbs, view.centerIm)) {
+        std::cout << job.output << ": bad centre " << job.centerRe << " " << job.centerIm << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Whether a job's output is its iteration field (see saveField) rather than
+// an image.
+bool isFieldPath(const std::string& path) {
+    const std::string suffix = ".field";
+    return path.size() > suffix.size() && path.compare(path.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// Computes a job on the pool without any window and hands it to writer to
+// be saved as a PNG, or saves its iteration field if the output ends in
+// .field.
+bool renderJobToPng(ThreadPool& pool, FrameWriter& writer, const RenderJob& job) {
+    DeepViewport view;
+    if (!jobViewport(job, view)) {
+        return false;
+    }
+
+    // Only z^2 + c has a perturbation path; the other formulas stay in double
+    // however deep the view.
+    bool deep = job.formula == FORMULA_MANDELBROT && view.dre < DEEP_ZOOM_PIXEL_SIZE;
+    Precision precision = deep ? PRECISION_DOUBLE : viewPrecision(toViewport(view), job.width, job.height);
+    precision = std::min(precision, PRECISION_DOUBLE);
+    EscapeSpanFn span = selectEscapeKernel(precision, job.formula).span;
+    TileRenderer tiles(pool, span, job.width, job.height, 1);
+    tiles.setSmooth(job.colorMode != COLOR_BANDED || isFieldPath(job.output));
+    tiles.setResumable(job.deepen);
+    tiles.setSeed(job.seedRe, job.seedIm);
+    auto startAt = [&](int maxIter) {
+        if (deep) {
+            tiles.start(makePerturbationRows(view, maxIter), maxIter);
+        } else {
+            tiles.start(toViewport(view), maxIter);
+        }
+    };
+    Uint64 start = SDL_GetPerformanceCounter();
+    startAt(job.maxIter);
+    tiles.wait();
+    long long iterations = tiles.stats().iterations;
+    int maxIter = job.deepen ? deepenUntilStable(tiles, job.maxIter, startAt, iterations) : job.maxIter;
+    std::string name = job.output + (deep ? " (perturbation" : std::string(" (") + precisionName(precision)) +
+                       (job.deepen ? ", deepened to " + std::to_string(maxIter) + " iterations)" : ")");
+    reportThroughput(name.c_str(), iterations, start, SDL_GetPerformanceCounter());
+    if (isFieldPath(job.output)) {
+        if (job.antialias) {
+            std::cout << "  antialiasing does not apply to fields" << std::endl;
+        }
+        if (!saveField(job.output, job.width, job.height, maxIter, tiles.iterations().data(),
+                       tiles.smoothIterations().data())) {
+            std::cout << "Could not save " << job.output << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    SDL_Surface* surface = writer.acquire(job.width, job.height);
+    if (!surface) {
+        return false;
+    }
+    Palette palette;
+    palette.setMaxIter(maxIter);
+    const std::vector<int>& iters = tiles.iterations();
+    const std::vector<float>& smooth = tiles.smoothIterations();
+    if (job.colorMode == COLOR_HISTOGRAM) {
+        palette.equalize(pool, iters.data(), (int)iters.size());
+    }
+    palette.colorFrame(pool, job.colorMode, iters.data(), smooth.empty() ? nullptr : smooth.data(), job.width,
+                       job.height, (Uint32*)surface->pixels, surface->pitch / 4);
+
+    // Subsamples are computed as rows of a view, which perturbation does not
+    // take.
+    if (job.antialias && deep) {
+        std::cout << "  antialiasing is not available for perturbation views" << std::endl;
+    } else if (job.antialias) {
+        Supersampler supersampler(pool, span, job.formula);
+        supersampler.setSeed(job.seedRe, job.seedIm);
+        Uint64 begin = SDL_GetPerformanceCounter();
+        SupersampleStats stats = supersampler.apply(toViewport(view), maxIter, palette, job.colorMode, iters.data(),
+                                                    smooth.empty() ? nullptr : smooth.data(), job.width, job.height,
+                                                    (Uint32*)surface->pixels, surface->pitch / 4);
+        reportSupersampling(stats, begin, job.width * job.height);
+    }
+    writer.write(surface, job.output);
+    return true;
+}
+
+// Identifies what a poster file holds: everything in the job but its file
+// name, hashed with FNV-1a.
+uint64_t posterFingerprint(const RenderJob& job) {
+    std::ostringstream text;
+    text.precision(17);
+    text << job.centerRe << " " << job.centerIm << " " << job.viewWidth << " " << job.width << " " << job.height << " "
+         << job.maxIter << " " << colorModeName(job.colorMode) << " " << job.formula << " " << job.seedRe << " "
+         << job.seedIm;
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (char c : text.str()) {
+        hash = (hash ^ (unsigned char)c) * 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+// Rows of the view at of a job, for TileRenderer and other row consumers:
+// computed by perturbation if deep is set, and by span otherwise.
+RowFunction jobRows(const RenderJob& job, const DeepViewport& at, EscapeSpanFn span, bool deep) {
+    if (deep) {
+        return makePerturbationRows(at, job.maxIter);
+    }
+    Viewport flat = toViewport(at);
+    EscapeRow base = { flat.re0, flat.dre, flat.im0, 0, 1, 0, job.maxIter, true, nullptr, nullptr, nullptr,
+                       job.seedRe, job.seedIm };
+    return [span, base, flat](int y, int x0, int step, int count, int* iters, float* smooth, EscapeStats& stats) {
+        EscapeRow row = base;
+        row.im = flat.im0 + y * flat.dim;
+        row.x0 = x0;
+        row.step = step;
+        row.count = count;
+        row.iters = iters;
+        row.smooth = smooth;
+        span(row, stats);
+    };
+}
+
+// Renders a job too large for memory into a poster file (see Poster),
+// continuing it if the file already holds part of it. Histogram coloring is
+// equalized on a preview POSTER_PREVIEW times smaller in each direction.
+int runPoster(const RenderJob& job) {
+    const int POSTER_PREVIEW = 16;
+    if (job.deepen || job.antialias) {
+        std::cout << "deepen and antialias are not available for posters" << std::endl;
+        return -1;
+    }
+    DeepViewport view;
+    if (!jobViewport(job, view)) {
+        return -1;
+    }
+    Poster poster;
+    if (!poster.open(job.output, job.width, job.height, posterFingerprint(job))) {
+        std::cout << "Could not open " << job.output << ", or it holds something other than this poster" << std::endl;
+        return -1;
+    }
+    int tiles = poster.tilesAcross() * poster.tilesDown();
+    int done = poster.tilesDone();
+    if (done > 0) {
+        std::cout << "Resuming: " << done << " of " << tiles << " tiles already done" << std::endl;
+    }
+
+    ThreadPool pool;
+    bool deep = job.formula == FORMULA_MANDELBROT && view.dre < DEEP_ZOOM_PIXEL_SIZE;
+    Precision precision = deep ? PRECISION_DOUBLE : viewPrecision(toViewport(view), job.width, job.height);
+    EscapeSpanFn span = selectEscapeKernel(std::min(precision, PRECISION_DOUBLE), job.formula).span;
+    auto rowsFor = [&](const DeepViewport& at) {
+        return jobRows(job, at, span, deep);
+    };
+
+    Palette palette;
+    palette.setMaxIter(job.maxIter);
+    if (job.colorMode == COLOR_HISTOGRAM) {
+        DeepViewport small = view;
+        small.width = std::max(job.width / POSTER_PREVIEW, 1);
+        small.height = std::max(job.height / POSTER_PREVIEW, 1);
+        small.dre = view.dre * job.width / small.width;
+        small.dim = view.dim * job.height / small.height;
+        TileRenderer preview(pool, span, small.width, small.height, 1);
+        preview.start(rowsFor(small), job.maxIter);
+        preview.wait();
+        palette.equalize(pool, preview.iterations().data(), (int)preview.iterations().size());
+    }
+
+    Uint64 start = SDL_GetPerformanceCounter();
+    PosterStats stats = poster.render(pool, rowsFor(view), palette, job.colorMode, [&](int tileRow, const PosterStats& sofar) {
+        double seconds = (double)(SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+        std::cout << "Tile row " << tileRow + 1 << " of " << poster.tilesDown() << ": " << sofar.tiles << " tiles, "
+                  << sofar.pixels / 1e6 / seconds << " Mpixels/s" << std::endl;
+    });
+    std::string name = job.output + (deep ? " (perturbation)" : std::string(" (") + precisionName(precision) + ")");
+    reportThroughput(name.c_str(), stats.iterations, start, SDL_GetPerformanceCounter());
+    return 0;
+}
+
+// Saves a finished poster as PNG strips of rows rows each, prefix00000.png,
+// prefix00001.png, ... from the top. Strips are encoded in parallel, with at
+// most about POSTER_STRIP_BYTES of them in memory.
+int runPosterStrips(const std::string& path, const std::string& prefix, int rows) {
+    const long long POSTER_STRIP_BYTES = 1LL << 28;
+    Poster poster;
+    if (!poster.open(path)) {
+        std::cout << "Could not open poster " << path << std::endl;
+        return -1;
+    }
+    int tiles = poster.tilesAcross() * poster.tilesDown();
+    if (poster.tilesDone() < tiles) {
+        std::cout << path << " is not finished: " << poster.tilesDone() << " of " << tiles << " tiles done" << std::endl;
+        return -1;
+    }
+    ThreadPool pool;
+    long long stripBytes = 4LL * poster.width() * rows;
+    FrameWriter writer(pool, (int)std::min<long long>(pool.size(), POSTER_STRIP_BYTES / stripBytes));
+    int strips = 0;
+    for (int y = 0; y < poster.height(); y += rows, ++strips) {
+        int count = std::min(rows, poster.height() - y);
+        SDL_Surface* strip = writer.acquire(poster.width(), count);
+        if (!strip) {
+            return -1;
+        }
+        poster.readRows(y, count, (Uint32*)strip->pixels, strip->pitch / 4);
+        char number[16];
+        std::snprintf(number, sizeof(number), "%05d.png", strips);
+        writer.write(strip, prefix + number);
+    }
+    if (writer.finish() > 0) {
+        return -1;
+    }
+    std::cout << strips << " strips of " << poster.width() << "x" << rows << " saved" << std::endl;
+    return 0;
+}
+
+// Colors a field saved by a render job in mode, with the gradient turned by
+// cycle of its length (see Palette::setCycle), and saves it as a PNG. Only
+// the coloring runs; nothing is iterated.
+int runRecolor(const std::string& path, const std::string& output, ColorMode mode, double cycle) {
+    IterationField field;
+    if (!loadField(path, field)) {
+        std::cout << "Could not read the field in " << path << std::endl;
+        return -1;
+    }
+    SDL_Surface* surface = SDL_CreateRGBSurfaceWithFormat(0, field.width, field.height, 32, SDL_PIXELFORMAT_ARGB8888);
+    if (!surface) {
+        std::cout << "Surface could not be created! SDL_Error: " << SDL_GetError() << std::endl;
+        return -1;
+    }
+    ThreadPool pool;
+    Uint64 start = SDL_GetPerformanceCounter();
+    Palette palette;
+    palette.setMaxIter(field.maxIter);
+    palette.setCycle(cycle);
+    if (mode == COLOR_HISTOGRAM) {
+        palette.equalize(pool, field.iters.data(), (int)field.iters.size());
+    }
+    palette.colorFrame(pool, mode, field.iters.data(), field.smooth.data(), field.width, field.height,
+                       (Uint32*)surface->pixels, surface->pitch / 4);
+    std::cout << output << ": " << field.width << "x" << field.height << " colored in "
+              << (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency() << " ms" << std::endl;
+    int result = 0;
+    if (IMG_SavePNG(surface, output.c_str()) != 0) {
+        std::cout << "Could not save " << output << "! SDL_Error: " << IMG_GetError() << std::endl;
+        result = -1;
+    }
+    SDL_FreeSurface(surface);
+    return result;
+}
+
+// A zoom into (centerRe, centerIm) at a constant rate, from a view
+// startWidth wide to one endWidth wide, over frames frames of width x height.
+// They are saved as prefix00000.png, prefix00001.png, ...
+struct ZoomVideo {
+    std::string centerRe;
+    std::string centerIm;
+    double startWidth;
+    double endWidth;
+    int width;
+    int height;
+    int frames;
+    int maxIter;
+    std::string prefix;
+    ColorMode colorMode;
+};
+
+bool parseZoomVideo(const std::vector<std::string>& fields, ZoomVideo& video) {
+    if (fields.size() < 9 || fields.size() > 10) {
+        return false;
+    }
+    video.colorMode = COLOR_BANDED;
+    if (fields.size() == 10 && !parseColorMode(fields[9], video.colorMode)) {
+        return false;
+    }
+    video.centerRe = fields[0];
+    video.centerIm = fields[1];
+    video.startWidth = std::atof(fields[2].c_str());
+    video.endWidth = std::atof(fields[3].c_str());
+    video.width = std::atoi(fields[4].c_str());
+    video.height = std::atoi(fields[5].c_str());
+    video.frames = std::atoi(fields[6].c_str());
+    video.maxIter = std::atoi(fields[7].c_str());
+    video.prefix = fields[8];
+    return video.startWidth > 0.0 && video.endWidth > 0.0 && video.width > 0 && video.height > 0 &&
+           video.frames > 1 && video.maxIter > 0;
+}
+
+// Renders the exponential map of the whole zoom once, colors it, and
+// resamples every frame from it (see ExpMapZoom).
+int runZoomVideo(const ZoomVideo& video) {
+    double startPixel = video.startWidth / video.width;
+    double endPixel = video.endWidth / video.width;
+    int limbs = BigFixed::limbsFor(std::min(startPixel, endPixel));
+    BigFixed centerRe(limbs), centerIm(limbs);
+    if (!BigFixed::parse(video.centerRe, limbs, centerRe) || !BigFixed::parse(video.centerIm, limbs, centerIm)) {
+        std::cout << "Bad centre " << video.centerRe << " " << video.centerIm << std::endl;
+        return -1;
+    }
+    ExpMapZoom zoom(video.width, video.height, std::max(startPixel, endPixel), std::min(startPixel, endPixel));
+    long long mapPixels = (long long)zoom.mapWidth() * zoom.mapHeight();
+    long long framePixels = (long long)video.frames * video.width * video.height;
+    std::cout << "Exponential map " << zoom.mapWidth() << "x" << zoom.mapHeight() << ": " << mapPixels / 1e6
+              << " Mpixels, against " << framePixels / 1e6 << " Mpixels of frames" << std::endl;
+    if (mapPixels > MAX_EXPMAP_PIXELS) {
+        std::cout << "That is more than " << MAX_EXPMAP_PIXELS / 1000000 << " Mpixels; use smaller frames or a shallower zoom"
+                  << std::endl;
+        return -1;
+    }
+
+    ThreadPool pool;
+    TileRenderer tiles(pool, selectEscapeKernel().span, zoom.mapWidth(), zoom.mapHeight(), 1);
+    tiles.setSmooth(video.colorMode != COLOR_BANDED);
+    Uint64 start = SDL_GetPerformanceCounter();
+    tiles.start(zoom.mapRows(centerRe, centerIm, std::min(startPixel, endPixel), video.maxIter), video.maxIter);
+    tiles.wait();
+    std::string name = "exponential map (perturbation) x " + std::to_string(pool.size()) + " threads";
+    reportThroughput(name.c_str(), tiles.stats().iterations, start, SDL_GetPerformanceCounter());
+
+    Palette palette;
+    palette.setMaxIter(video.maxIter);
+    const std::vector<int>& iters = tiles.iterations();
+    const std::vector<float>& smooth = tiles.smoothIterations();
+    if (video.colorMode == COLOR_HISTOGRAM) {
+        palette.equalize(pool, iters.data(), (int)iters.size());
+    }
+    std::vector<Uint32> map(mapPixels);
+    palette.colorFrame(pool, video.colorMode, iters.data(), smooth.empty() ? nullptr : smooth.data(), zoom.mapWidth(),
+                       zoom.mapHeight(), map.data(), zoom.mapWidth());
+
+    // Frames are resampled while earlier ones are being saved.
+    FrameWriter writer(pool, pool.size());
+    Uint64 resampling = 0;
+    Uint64 begin = SDL_GetPerformanceCounter();
+    for (int frame = 0; frame < video.frames; ++frame) {
+        SDL_Surface* surface = writer.acquire(video.width, video.height);
+        if (!surface) {
+            return -1;
+        }
+        double pixelSize = startPixel * std::pow(endPixel / startPixel, (double)frame / (video.frames - 1));
+        start = SDL_GetPerformanceCounter();
+        zoom.frame(pool, map.data(), pixelSize, (Uint32*)surface->pixels, surface->pitch / 4);
+        resampling += SDL_GetPerformanceCounter() - start;
+        char number[16];
+        std::snprintf(number, sizeof(number), "%05d.png", frame);
+        writer.write(surface, video.prefix + number);
+    }
+    if (writer.finish() > 0) {
+        return -1;
+    }
+    double frequency = (double)SDL_GetPerformanceFrequency();
+    std::cout << video.frames << " frames resampled in " << resampling * 1000.0 / frequency / video.frames
+              << " ms each, and computed and saved in "
+              << (SDL_GetPerformanceCounter() - begin) * 1000.0 / frequency / video.frames << " ms each" << std::endl;
+    return 0;
+}
+
+// A Buddhabrot, or with anti an anti-Buddhabrot, of width x height from
+// samples samples of c; the view fits a 3 x 2.6 box around the set.
+struct BuddhabrotJob {
+    int width;
+    int height;
+    long long samples;
+    int maxIter;
+    std::string output;
+    bool anti;
+};
+
+bool parseBuddhabrotJob(const std::vector<std::string>& fields, BuddhabrotJob& job) {
+    if (fields.size() < 5 || fields.size() > 6) {
+        return false;
+    }
+    job.anti = fields.size() == 6;
+    if (job.anti && fields[5] != "anti") {
+        return false;
+    }
+    job.width = std::atoi(fields[0].c_str());
+    job.height = std::atoi(fields[1].c_str());
+    job.samples = (long long)std::atof(fields[2].c_str());
+    job.maxIter = std::atoi(fields[3].c_str());
+    job.output = fields[4];
+    return job.width > 0 && job.height > 0 && job.samples > 0 && job.maxIter > 0;
+}
+
+// Accumulates the samples in batches of BUDDHABROT_BATCH, reporting each,
+// and saves the density as gray levels.
+int runBuddhabrot(const BuddhabrotJob& job) {
+    ThreadPool pool;
+    EscapeKernel kernel = selectEscapeKernel();
+    double pixel = std::max(3.0 / job.width, 2.6 / job.height);
+    Viewport view = { -0.5 - 0.5 * job.width * pixel, -0.5 * job.height * pixel, pixel, pixel };
+    Uint64 start = SDL_GetPerformanceCounter();
+    Buddhabrot buddhabrot(pool, kernel.span, view, job.width, job.height, job.maxIter, job.anti);
+    Uint64 masked = SDL_GetPerformanceCounter();
+    BuddhabrotStats total;
+    for (long long done = 0; done < job.samples; done += BUDDHABROT_BATCH) {
+        long long batch = std::min(BUDDHABROT_BATCH, job.samples - done);
+        total.add(buddhabrot.accumulate(batch, (Uint64)(done / BUDDHABROT_BATCH)));
+        double seconds = (double)(SDL_GetPerformanceCounter() - masked) / SDL_GetPerformanceFrequency();
+        std::cout << total.samples / 1e6 << " M samples, " << total.orbits / 1e6 << " M orbits, "
+                  << total.points / 1e6 << " M points in " << seconds << " s (" << total.samples / 1e6 / seconds
+                  << " M samples/s)" << std::endl;
+    }
+    std::cout << "Mask skipped " << 100.0 * buddhabrot.skipped() << "% of the sampled region in "
+              << (masked - start) * 1000.0 / SDL_GetPerformanceFrequency() << " ms" << std::endl;
+    std::string name = std::string(kernel.name) + " x " + std::to_string(pool.size()) + " threads";
+    reportThroughput(name.c_str(), total.iterations, masked, SDL_GetPerformanceCounter());
+
+    SDL_Surface* surface = SDL_CreateRGBSurfaceWithFormat(0, job.width, job.height, 32, SDL_PIXELFORMAT_ARGB8888);
+    if (!surface) {
+        std::cout << "Surface could not be created! SDL_Error: " << SDL_GetError() << std::endl;
+        return -1;
+    }
+    buddhabrot.toImage((Uint32*)surface->pixels, surface->pitch / 4);
+    bool saved = IMG_SavePNG(surface, job.output.c_str()) == 0;
+    if (!saved) {
+        std::cout << "Could not save " << job.output << "! SDL_Error: " << IMG_GetError() << std::endl;
+    }
+    SDL_FreeSurface(surface);
+    return saved ? 0 : -1;
+}
+
+// Renders every job with a RenderFarm of workers processes and saves it. A
+// thread pool colors each finished frame, and is gone again before the next
+// job forks its workers.
+int runFarm(int workers, const std::vector<RenderJob>& jobs) {
+#ifdef _WIN32
+    std::cout << "The render farm needs fork(), which is not available on Windows" << std::endl;
+    return -1;
+#else
+    int failures = 0;
+    for (const RenderJob& job : jobs) {
+        DeepViewport view;
+        if (job.deepen || job.antialias) {
+            std::cout << job.output << ": deepen and antialias are not available in the render farm" << std::endl;
+            failures++;
+            continue;
+        }
+        if (!jobViewport(job, view)) {
+            failures++;
+            continue;
+        }
+        bool deep = job.formula == FORMULA_MANDELBROT && view.dre < DEEP_ZOOM_PIXEL_SIZE;
+        Precision precision = deep ? PRECISION_DOUBLE : viewPrecision(toViewport(view), job.width, job.height);
+        EscapeSpanFn span = selectEscapeKernel(std::min(precision, PRECISION_DOUBLE), job.formula).span;
+        RenderFarm farm(job.width, job.height, job.colorMode != COLOR_BANDED || isFieldPath(job.output));
+        FarmStats stats;
+        Uint64 start = SDL_GetPerformanceCounter();
+        // A deep job's reference orbit is computed here, once, for the
+        // workers to inherit when they fork.
+        RowFunction rows = jobRows(job, view, span, deep);
+        bool rendered = farm.render(rows, workers, stats);
+        std::string name = job.output + " (" + (deep ? "perturbation" : precisionName(precision)) + " x " +
+                           std::to_string(workers) + " processes)";
+        reportThroughput(name.c_str(), stats.iterations, start, SDL_GetPerformanceCounter());
+        if (stats.crashes > 0) {
+            std::cout << "  " << stats.crashes << " workers died, " << stats.reassigned << " tiles reassigned"
+                      << std::endl;
+        }
+        if (!rendered) {
+            std::cout << job.output << ": the farm could not compute every tile" << std::endl;
+            failures++;
+            continue;
+        }
+        if (isFieldPath(job.output)) {
+            if (!saveField(job.output, job.width, job.height, job.maxIter, farm.iterations(),
+                           farm.smoothIterations())) {
+                std::cout << "Could not save " << job.output << std::endl;
+                failures++;
+            }
+            continue;
+        }
+
+        ThreadPool pool;
+        SDL_Surface* surface = SDL_CreateRGBSurfaceWithFormat(0, job.width, job.height, 32, SDL_PIXELFORMAT_ARGB8888);
+        if (!surface) {
+            std::cout << "Surface could not be created! SDL_Error: " << SDL_GetError() << std::endl;
+            return -1;
+        }
+        Palette palette;
+        palette.setMaxIter(job.maxIter);
+        if (job.colorMode == COLOR_HISTOGRAM) {
+            palette.equalize(pool, farm.iterations(), job.width * job.height);
+        }
+        palette.colorFrame(pool, job.colorMode, farm.iterations(), farm.smoothIterations(), job.width, job.height,
+                           (Uint32*)surface->pixels, surface->pitch / 4);
+        if (IMG_SavePNG(surface, job.output.c_str()) != 0) {
+            std::cout << "Could not save " << job.output << "! SDL_Error: " << IMG_GetError() << std::endl;
+            failures++;
+        }
+        SDL_FreeSurface(surface);
+    }
+    return failures == 0 ? 0 : 1;
+#endif
+}
+
+// Renders every job headless, reporting each frame's compute time. Frames
+// are saved while the next ones are computed.
+int runBatch(const std::vector<RenderJob>& jobs) {
+    ThreadPool pool;
+    FrameWriter writer(pool, pool.size());
+    EscapeKernel kernel = selectEscapeKernel();
+    std::cout << kernel.name << " x " << pool.size() << " threads" << std::endl;
+    Uint64 start = SDL_GetPerformanceCounter();
+    int failures = 0;
+    for (const RenderJob& job : jobs) {
+        failures += renderJobToPng(pool, writer, job) ? 0 : 1;
+    }
+    failures += writer.finish();
+    if (jobs.size() > 1) {
+        std::cout << jobs.size() << " frames computed and saved in "
+                  << (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency() << " ms" << std::endl;
+    }
+    return failures == 0 ? 0 : 1;
+}
+
+// One job per line of path; blank lines and lines starting with # are skipped.
+bool readRenderJobs(const std::string& path, std::vector<RenderJob>& jobs) {
+    std::ifstream file(path);
+    if (!file) {
+        std::cout << "Could not open " << path << std::endl;
+        return false;
+    }
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line)) {
+        lineNumber++;
+        std::istringstream words(line);
+        std::vector<std::string> fields;
+        std::string field;
+        while (words >> field) {
+            fields.push_back(field);
+        }
+        if (fields.empty() || fields[0][0] == '#') {
+            continue;
+        }
+        RenderJob job;
+        if (!parseRenderJob(fields, job)) {
+            std::cout << path << ":" << lineNumber << ": expected <re> <im> <view width> <width> <height> "
+                      << "<max iterations> <output.png> [banded | smooth | histogram] [deepen] [antialias] [<formula>]"
+                      << std::endl;
+            return false;
+        }
+        jobs.push_back(job);
+    }
+    return true;
+}
+
+void printUsage() {
+    std::cout << "Usage: Main [--bench | --stats | --verify | --precision | --fixed-point | --antialias]\n"
+              << "       Main --bench-suite [<output.json> [<baseline.json>]]\n"
+              << "       Main --render <re> <im> <view width> <width> <height> <max iterations> <output.png>"
+              << " [banded | smooth | histogram] [deepen] [antialias] [<formula>]\n"
+              << "       Main --batch <file with one render per line>\n"
+              << "       Main --farm <worker processes> (<render job fields> | --batch <file>)\n"
+              << "       Main --zoom-video <re> <im> <start width> <end width> <width> <height> <frames>"
+              << " <max iterations> <output prefix> [banded | smooth | histogram]\n"
+              << "       Main --poster <re> <im> <view width> <width> <height> <max iterations> <output.poster>"
+              << " [banded | smooth | histogram] [<formula>]\n"
+              << "       Main --poster-strips <poster> <output prefix> [rows per strip]\n"
+              << "       Main --recolor <input.field> <output.png> [banded | smooth | histogram] [<cycle>]\n"
+              << "       Main --buddhabrot <width> <height> <samples> <max iterations> <output.png> [anti]\n"
+              << "       Main [--deep <re> <im> <pixel size> [max iterations]] [--cache] [--cache-file <path>]"
+              << " [--subdivide] [--cap-limit <n>]\n"
+              << "            [--formula mandelbrot | multibrot3 | multibrot4 | burning-ship] [--julia <re> <im>]\n"
+              << "Formulas in render jobs: mandelbrot, multibrot3, multibrot4, burning-ship, julia or julia:<re>,<im>"
+              << std::endl;
 }
 
 int main(int argc, char* argv[]) {
+    if (argc > 1 && std::strcmp(argv[1], "--bench") == 0) {
+        return runBenchmark();
+    }
+    if (argc > 1 && std::strcmp(argv[1], "--bench-suite") == 0 && argc <= 4) {
+        return runBenchSuite(argc > 2 ? argv[2] : "", argc > 3 ? argv[3] : "");
+    }
+    if (argc > 1 && std::strcmp(argv[1], "--stats") == 0) {
+        return runShortcutStats();
+    }
+    if (argc > 1 && std::strcmp(argv[1], "--verify") == 0) {
+        return runShortcutVerify();
+    }
+    if (argc > 1 && std::strcmp(argv[1], "--precision") == 0) {
+        return runPrecisionReport();
+    }
+    if (argc > 1 && std::strcmp(argv[1], "--fixed-point") == 0) {
+        return runFixedPointReport();
+    }
+    if (argc > 1 && std::strcmp(argv[1], "--antialias") == 0) {
+        return runAntialiasReport();
+    }
+    if (argc > 1 && std::strcmp(argv[1], "--render") == 0) {
+        RenderJob job;
+        if (!parseRenderJob(std::vector<std::string>(argv + 2, argv + argc), job)) {
+            printUsage();
+            return -1;
+        }
+        return runBatch({ job });
+    }
+    if (argc > 1 && std::strcmp(argv[1], "--zoom-video") == 0) {
+        ZoomVideo video;
+        if (!parseZoomVideo(std::vector<std::string>(argv + 2, argv + argc), video)) {
+            printUsage();
+            return -1;
+        }
+        return runZoomVideo(video);
+    }
+    if (argc > 1 && std::strcmp(argv[1], "--poster") == 0) {
+        RenderJob job;
+        if (!parseRenderJob(std::vector<std::string>(argv + 2, argv + argc), job)) {
+            printUsage();
+            return -1;
+        }
+        return runPoster(job);
+    }
+    if (argc > 1 && std::strcmp(argv[1], "--poster-strips") == 0 && (argc == 4 || argc == 5)) {
+        int rows = argc == 5 ? std::atoi(argv[4]) : Poster::POSTER_TILE;
+        if (rows <= 0) {
+            printUsage();
+            return -1;
+        }
+        return runPosterStrips(argv[2], argv[3], rows);
+    }
+    if (argc > 1 && std::strcmp(argv[1], "--recolor") == 0 && argc >= 4 && argc <= 6) {
+        ColorMode mode = COLOR_SMOOTH;
+        if (argc >= 5 && !parseColorMode(argv[4], mode)) {
+            printUsage();
+            return -1;
+        }
+        return runRecolor(argv[2], argv[3], mode, argc == 6 ? std::atof(argv[5]) : 0.0);
+    }
+    if (argc > 1 && std::strcmp(argv[1], "--buddhabrot") == 0) {
+        BuddhabrotJob job;
+        if (!parseBuddhabrotJob(std::vector<std::string>(argv + 2, argv + argc), job)) {
+            printUsage();
+            return -1;
+        }
+        return runBuddhabrot(job);
+    }
+    if (argc > 2 && std::strcmp(argv[1], "--farm") == 0) {
+        int workers = std::atoi(argv[2]);
+        std::vector<RenderJob> jobs(1);
+        bool parsed;
+        if (argc == 5 && std::strcmp(argv[3], "--batch") == 0) {
+            jobs.clear();
+            parsed = readRenderJobs(argv[4], jobs);
+        } else {
+            parsed = parseRenderJob(std::vector<std::string>(argv + 3, argv + argc), jobs[0]);
+        }
+        if (workers <= 0 || !parsed) {
+            printUsage();
+            return -1;
+        }
+        return runFarm(workers, jobs);
+    }
+    if (argc > 1 && std::strcmp(argv[1], "--batch") == 0) {
+        std::vector<RenderJob> jobs;
+        if (argc != 3 || !readRenderJobs(argv[2], jobs)) {
+            printUsage();
+            return -1;
+        }
+        return runBatch(jobs);
+    }
+
+    // Views with pixels smaller than DEEP_ZOOM_PIXEL_SIZE are rendered by
+    // perturbation around a fixed-point centre, whether they were given
+    // with --deep or reached by zooming. That only works for z^2 + c; the
+    // other formulas stay in double.
+    Viewport view = DEFAULT_VIEW;
+    DeepViewport deepView = toDeepViewport(view, SCREEN_WIDTH, SCREEN_HEIGHT);
+    bool deep = false;
+    bool viewGiven = false;
+    int maxIter = MAX_ITER;
+    int capLimit = DEEPEN_LIMIT;
+    bool useCache = false;
+    bool subdivide = false;
+    std::string cacheFile;
+    Formula formula = FORMULA_MANDELBROT;
+    double seedRe = JULIA_RE, seedIm = JULIA_IM;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--deep") == 0 && i + 3 < argc) {
+            double pixelSize = std::atof(argv[i + 3]);
+            int limbs = BigFixed::limbsFor(pixelSize);
+            if (pixelSize <= 0.0 || !BigFixed::parse(argv[i + 1], limbs, deepView.centerRe) ||
+                !BigFixed::parse(argv[i + 2], limbs, deepView.centerIm)) {
+                printUsage();
+                return -1;
+            }
+            deepView.dre = pixelSize;
+            deepView.dim = pixelSize;
+            i += 3;
+            if (i + 1 < argc && std::strncmp(argv[i + 1], "--", 2) != 0) {
+                maxIter = std::atoi(argv[++i]);
+            }
+            viewGiven = true;
+        } else if (std::strcmp(argv[i], "--formula") == 0 && i + 1 < argc) {
+            if (!parseFormula(argv[++i], formula)) {
+                printUsage();
+                return -1;
+            }
+        } else if (std::strcmp(argv[i], "--julia") == 0 && i + 2 < argc) {
+            formula = FORMULA_JULIA;
+            seedRe = std::atof(argv[i + 1]);
+            seedIm = std::atof(argv[i + 2]);
+            i += 2;
+        } else if (std::strcmp(argv[i], "--cap-limit") == 0 && i + 1 < argc) {
+            capLimit = std::atoi(argv[++i]);
+            if (capLimit < AUTO_CAP_MIN) {
+                printUsage();
+                return -1;
+            }
+        } else if (std::strcmp(argv[i], "--cache") == 0) {
+            useCache = true;
+        } else if (std::strcmp(argv[i], "--subdivide") == 0) {
+            subdivide = true;
+        } else if (std::strcmp(argv[i], "--cache-file") == 0 && i + 1 < argc) {
+            useCache = true;
+            cacheFile = argv[++i];
+        } else {
+            printUsage();
+            return -1;
+        }
+    }
+    bool perturbable = formula == FORMULA_MANDELBROT;
+    if (viewGiven) {
+        view = toViewport(deepView);
+        deep = perturbable && std::min(deepView.dre, deepView.dim) < DEEP_ZOOM_PIXEL_SIZE;
+    } else {
+        view = formulaView(formula);
+        deepView = toDeepViewport(view, SCREEN_WIDTH, SCREEN_HEIGHT);
+    }
+
     if (SDL_Init(SDL_INIT_VIDEO) < 0) {
         std::cout << "SDL could not initialize! SDL_Error: " << SDL_GetError() << std::endl;
         return -1;
@@ -47,24 +1709,371 @@ int main(int argc, char* argv[]) {
                                           SDL_WINDOW_SHOWN);
 
     SDL_Renderer* renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+    Framebuffer framebuffer(renderer, SCREEN_WIDTH, SCREEN_HEIGHT);
 
-    for (int y = 0; y < SCREEN_HEIGHT; ++y) {
-        for (int x = 0; x < SCREEN_WIDTH; ++x) {
-            std::complex<double> c = pixelToComplex(x, y);
-            int iter = mandelbrot(c);
+    ThreadPool pool;
+    EscapeKernel kernel = selectEscapeKernel(PRECISION_DOUBLE, formula);
+    EscapeKernel floatKernel = selectEscapeKernel(PRECISION_FLOAT, formula);
+    TileRenderer tiles(pool, kernel.span, SCREEN_WIDTH, SCREEN_HEIGHT);
+    tiles.setSeed(seedRe, seedIm);
+    tiles.setSmooth(true);
+    tiles.setSubdivision(subdivide);
+    tiles.setResumable(true);
+    Palette palette;
+    ColorMode colorMode = COLOR_BANDED;
+    Supersampler supersampler(pool, kernel.span, formula);
+    supersampler.setSeed(seedRe, seedIm);
+    Accumulator accumulator(pool, kernel.span, SCREEN_WIDTH, SCREEN_HEIGHT);
+    accumulator.setSeed(seedRe, seedIm);
+
+    // Shallow views can be served from a tile pyramid, so panning back or
+    // zooming out reuses work instead of redoing it.
+    TileCache cache(kernel.span, TILE_CACHE_TILES, formula, seedRe, seedIm);
+    if (!cacheFile.empty() && !cache.openStore(cacheFile, TILE_STORE_SLOTS)) {
+        std::cout << "Could not open tile cache file " << cacheFile << std::endl;
+        return -1;
+    }
+
+    // Shallow views are computed in float while that resolves the pixels.
+    // deepenFrom is the number of pixels still running when the current frame
+    // was deepened from the previous cap, or -1 for a new frame.
+    Uint64 start = 0;
+    bool reported = false;
+    std::string frameName;
+    long long deepenFrom = -1;
+    bool autoDeepen = false;
+    bool settled = false;
+    bool antialias = false;
+    int antialiasedRows = 0;
+    Uint64 antialiasStart = 0;
+    SupersampleStats antialiasStats;
+    bool accumulate = true;
+    Uint64 accumulateStart = 0;
+    long long accumulated = 0;
+
+    // While cycling, the gradient is turned by cycleFrom plus the time since
+    // cycleStart, and the frame recolored from its counts at most every
+    // CYCLE_FRAME_MS, at cycledAt last.
+    bool cycling = false;
+    double cycleFrom = 0.0;
+    Uint64 cycleStart = 0;
+    Uint64 cycledAt = 0;
+    auto cyclePhase = [&]() {
+        double elapsed = (double)(SDL_GetPerformanceCounter() - cycleStart) / SDL_GetPerformanceFrequency();
+        return cycleFrom + elapsed * 1000.0 / CYCLE_PERIOD_MS;
+    };
 
-            int r, g, b;
-            getColor(iter, r, g, b);
+    // With autoCap on, every finished frame picks nextCap, the cap of the
+    // frames after it, and is deepened to it at once if its own cap was too
+    // low; capSettled says it was not.
+    IterationCapController capController(AUTO_CAP_MIN, capLimit, DEEPEN_STABLE);
+    bool autoCap = true;
+    bool capSettled = false;
+    int nextCap = std::min(maxIter, capLimit);
 
-            SDL_SetRenderDrawColor(renderer, r, g, b, 255);
-            SDL_RenderDrawPoint(renderer, x, y);
+    // Starts a frame of the current view. moved, if given, says where its
+    // pixels lie in the frame on screen, which the new one starts from (see
+    // TileRenderer). Pixels are only reused if they are computed the same way
+    // and with the same cap, frameCap being the cap of the frame on screen.
+    // Deep frames start against the reference of the frame before when it
+    // serves them. Otherwise a new one is computed as a pool task, with the
+    // warped frame held on screen until it is ready, and cancelled if the
+    // view moves on before then.
+    int frameCap = 0;
+    std::shared_ptr<DeepReference> reference;
+    bool orbitPending = false;
+    auto startFrame = [&](const Warp* moved) {
+        start = SDL_GetPerformanceCounter();
+        std::string previousName = frameName;
+        if (autoCap) {
+            maxIter = nextCap;
         }
-    }
+        palette.setMaxIter(maxIter);
+        Precision precision = std::min(viewPrecision(view, SCREEN_WIDTH, SCREEN_HEIGHT), PRECISION_DOUBLE);
+        EscapeKernel& chosen = precision == PRECISION_FLOAT ? floatKernel : kernel;
+        std::string threads = " x " + std::to_string(pool.size()) + " threads";
+        if (deep) {
+            frameName = "perturbation" + threads;
+        } else if (useCache) {
+            frameName = std::string("tile cache, ") + kernel.name + threads;
+        } else {
+            frameName = std::string(chosen.name) + " " + precisionName(precision) + threads;
+        }
+        Warp warp = moved ? *moved : Warp();
+        warp.reuse = frameName == previousName && maxIter == frameCap;
+        frameCap = maxIter;
+        const Warp* reprojection = moved ? &warp : nullptr;
+        if (!deep && reference && !reference->ready()) {
+            reference->cancel();
+            reference.reset();
+        }
+        orbitPending = false;
+        if (deep) {
+            if (!reference || !reference->serves(deepView, maxIter)) {
+                if (reference) {
+                    reference->cancel();
+                }
+                std::shared_ptr<DeepReference> next = std::make_shared<DeepReference>(deepView, maxIter);
+                pool.submit([next] { next->compute(); });
+                reference = next;
+            }
+            if (reference->ready()) {
+                tiles.start(makePerturbationRows(reference, deepView, maxIter), maxIter, reprojection);
+            } else {
+                tiles.hold(maxIter, warp);
+                orbitPending = true;
+            }
+        } else if (useCache) {
+            tiles.start(PyramidRows{ &cache, view, maxIter }, maxIter, reprojection);
+            supersampler.setKernel(kernel.span);
+            accumulator.setKernel(kernel.span);
+        } else {
+            tiles.setKernel(chosen.span);
+            supersampler.setKernel(chosen.span);
+            accumulator.setKernel(chosen.span);
+            tiles.start(view, maxIter, reprojection);
+        }
+        reported = false;
+        antialiasedRows = 0;
+        accumulator.reset();
+        capSettled = false;
+        deepenFrom = -1;
+    };
+    startFrame(nullptr);
 
-    SDL_RenderPresent(renderer);
+    // Raises the cap to cap. A finished frame from a view only continues the
+    // pixels that have not escaped; anything else is computed again.
+    auto deepenFrame = [&](int cap) {
+        long long running = countUnescaped(tiles.iterations(), maxIter);
+        maxIter = cap;
+        nextCap = cap;
+        std::cout << "Max iterations: " << maxIter << std::endl;
+        if (tiles.deepen(maxIter)) {
+            frameCap = maxIter;
+            start = SDL_GetPerformanceCounter();
+            palette.setMaxIter(maxIter);
+            reported = false;
+            antialiasedRows = 0;
+            accumulator.reset();
+            capSettled = false;
+        } else {
+            Warp unmoved;
+            startFrame(&unmoved);
+        }
+        deepenFrom = running;
+    };
 
-    SDL_Delay(5000);
+    std::vector<Tile> finished;
+    bool quit = false;
+    SDL_Event e;
 
+    // Mouse wheel zooms around the cursor, dragging with the left button pans
+    // and C switches between the color modes. I doubles the iteration cap, and
+    // D toggles doubling it whenever a frame finishes until the image settles.
+    // M toggles picking the cap from the escape times of the last frame. A
+    // toggles antialiasing finished frames, and P adding samples to them for
+    // as long as the view stays still. O toggles color cycling, and S saves
+    // the counts of the finished frame to mandelbrot.field.
+    while (!quit) {
+        bool viewChanged = false;
+        Warp moved;
+        bool recolor = false;
+        bool deepen = false;
+        while (SDL_PollEvent(&e) != 0) {
+            if (e.type == SDL_QUIT) {
+                quit = true;
+            } else if (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_c) {
+                colorMode = (ColorMode)((colorMode + 1) % 3);
+                std::cout << "Coloring: " << colorModeName(colorMode) << std::endl;
+                recolor = true;
+            } else if (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_i) {
+                deepen = maxIter <= DEEPEN_LIMIT / 2;
+            } else if (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_a) {
+                antialias = !antialias;
+                std::cout << "Antialiasing: " << (antialias ? "on" : "off") << std::endl;
+                recolor = !antialias;
+            } else if (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_p) {
+                accumulate = !accumulate;
+                std::cout << "Accumulating samples: " << (accumulate ? "on" : "off") << std::endl;
+                recolor = true;
+            } else if (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_o) {
+                if (cycling) {
+                    cycleFrom = cyclePhase();
+                } else {
+                    cycleStart = SDL_GetPerformanceCounter();
+                }
+                cycling = !cycling;
+                std::cout << "Color cycling: " << (cycling ? "on" : "off") << std::endl;
+                recolor = true;
+            } else if (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_s) {
+                if (!tiles.done()) {
+                    std::cout << "The frame is not finished yet" << std::endl;
+                } else if (saveField("mandelbrot.field", SCREEN_WIDTH, SCREEN_HEIGHT, maxIter,
+                                     tiles.iterations().data(), tiles.smoothIterations().data())) {
+                    std::cout << "Saved the frame's counts to mandelbrot.field" << std::endl;
+                } else {
+                    std::cout << "Could not save mandelbrot.field" << std::endl;
+                }
+            } else if (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_m) {
+                autoCap = !autoCap;
+                nextCap = maxIter;
+                std::cout << "Automatic iteration cap: " << (autoCap ? "on" : "off") << std::endl;
+            } else if (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_d) {
+                autoDeepen = !autoDeepen;
+                std::cout << "Deepening until stable: " << (autoDeepen ? "on" : "off") << std::endl;
+            } else if (e.type == SDL_MOUSEWHEEL && e.wheel.y != 0) {
+                int mouseX, mouseY;
+                SDL_GetMouseState(&mouseX, &mouseY);
+                double factor = std::pow(ZOOM_STEP, e.wheel.y);
+                if (!deep) {
+                    deepView = toDeepViewport(view, SCREEN_WIDTH, SCREEN_HEIGHT);
+                }
+                deepView = zoomDeepViewport(deepView, mouseX, mouseY, factor);
+                deep = perturbable && std::min(deepView.dre, deepView.dim) < DEEP_ZOOM_PIXEL_SIZE;
+                view = deep ? toViewport(deepView) : zoomViewport(view, mouseX, mouseY, factor);
+                moved = moved.after({ factor, (1.0 - factor) * mouseX, (1.0 - factor) * mouseY });
+                viewChanged = true;
+            } else if (e.type == SDL_MOUSEMOTION && (e.motion.state & SDL_BUTTON_LMASK)) {
+                if (deep) {
+                    deepView = panDeepViewport(deepView, e.motion.xrel, e.motion.yrel);
+                }
+                view = panViewport(view, e.motion.xrel, e.motion.yrel);
+                moved = moved.after({ 1.0, (double)-e.motion.xrel, (double)-e.motion.yrel });
+                viewChanged = true;
+            }
+        }
+
+        // A moved view is shown at once from the frame on screen, warped.
+        if (orbitPending && !viewChanged && reference->ready()) {
+            Warp unmoved;
+            tiles.start(makePerturbationRows(reference, deepView, maxIter), maxIter, &unmoved);
+            orbitPending = false;
+        }
+        if (viewChanged) {
+            startFrame(&moved);
+            recolor = true;
+        } else if (deepen || (autoDeepen && reported && !settled)) {
+            deepenFrame(maxIter * 2);
+            recolor = true;
+        } else if (autoCap && reported && !capSettled) {
+            deepenFrame(nextCap);
+            recolor = true;
+        }
+
+        // Histogram coloring depends on every pixel, so it recolors the whole
+        // frame whenever any of it changes. Cycling only turns the gradient.
+        tiles.takeFinished(finished);
+        const std::vector<int>& iters = tiles.iterations();
+        const std::vector<float>& smooth = tiles.smoothIterations();
+        if (colorMode == COLOR_HISTOGRAM && (recolor || !finished.empty())) {
+            palette.equalize(pool, iters.data(), (int)iters.size());
+            recolor = true;
+        }
+        Uint64 now = SDL_GetPerformanceCounter();
+        if (cycling && now - cycledAt >= CYCLE_FRAME_MS * SDL_GetPerformanceFrequency() / 1000 &&
+            palette.setCycle(cyclePhase())) {
+            cycledAt = now;
+            recolor = true;
+        }
+        if (recolor) {
+            palette.colorFrame(pool, colorMode, iters.data(), smooth.data(), SCREEN_WIDTH, SCREEN_HEIGHT,
+                               framebuffer.data(), SCREEN_WIDTH);
+            antialiasedRows = 0;
+            accumulator.reset();
+        } else {
+            for (const Tile& tile : finished) {
+                for (int y = tile.y; y < tile.y + tile.height; ++y) {
+                    int offset = y * SCREEN_WIDTH + tile.x;
+                    palette.colorRow(colorMode, &iters[offset], &smooth[offset], framebuffer.row(y) + tile.x, tile.width);
+                }
+            }
+        }
+        if (recolor || !finished.empty()) {
+            framebuffer.present();
+        }
+
+        if (!reported && tiles.done()) {
+            reportThroughput(frameName.c_str(), tiles.stats().iterations, start, SDL_GetPerformanceCounter());
+            long long running = countUnescaped(tiles.iterations(), maxIter);
+            settled = maxIter > DEEPEN_LIMIT / 2 ||
+                      (deepenFrom >= 0 && deepenFrom - running < DEEPEN_STABLE * SCREEN_WIDTH * SCREEN_HEIGHT);
+            if (autoDeepen && settled) {
+                std::cout << "  settled at " << maxIter << " iterations" << std::endl;
+            }
+            if (autoCap) {
+                EscapeProfile profile;
+                int cap = capController.nextCap(iters.data(), (int)iters.size(), maxIter, &profile);
+                std::cout << "  " << 100.0 * profile.capped / profile.pixels << "% of the pixels reached the cap";
+                if (cap > maxIter) {
+                    std::cout << ", raising it to " << cap;
+                } else if (cap < nextCap) {
+                    std::cout << ", next frames cap at " << cap;
+                }
+                std::cout << std::endl;
+                capSettled = cap <= maxIter;
+                nextCap = cap;
+            }
+            if (subdivide) {
+                std::cout << "  subdivision computed " << 100.0 * tiles.samples() / (SCREEN_WIDTH * SCREEN_HEIGHT)
+                          << "% of the pixels" << std::endl;
+            }
+            if (useCache) {
+                TileCache::Counters counters = cache.getCounters();
+                std::cout << "  tile cache: " << counters.memoryHits << " hits, " << counters.storeHits
+                          << " from disk, " << counters.assembled << " assembled, " << counters.computed
+                          << " computed (" << counters.seeded << " seeded from parent)" << std::endl;
+            }
+            reported = true;
+        }
+
+        // Adds samples where the finished frame needs them, once it is not
+        // about to be deepened. Perturbation views are left as they are.
+        // Both go a band of rows per pass of the loop, so input is handled
+        // in between. Accumulated samples replace the one-off antialiasing;
+        // they start from the frame's own colors, and any change to it starts
+        // them over, so a cycling frame gets none.
+        bool idle = reported && (!autoDeepen || settled) && (!autoCap || capSettled);
+        bool still = idle && !deep && !cycling;
+        if (antialias && !accumulate && antialiasedRows < SCREEN_HEIGHT && still) {
+            if (antialiasedRows == 0) {
+                antialiasStart = SDL_GetPerformanceCounter();
+                antialiasStats = SupersampleStats();
+            }
+            SupersampleStats band =
+                supersampler.applyRows(view, maxIter, palette, colorMode, iters.data(), smooth.data(), SCREEN_WIDTH,
+                                       SCREEN_HEIGHT, antialiasedRows, ACCUMULATE_ROWS, framebuffer.data(),
+                                       SCREEN_WIDTH);
+            antialiasStats.pixels += band.pixels;
+            antialiasStats.samples += band.samples;
+            antialiasStats.iterations += band.iterations;
+            antialiasedRows = std::min(SCREEN_HEIGHT, antialiasedRows + ACCUMULATE_ROWS);
+            framebuffer.present();
+            if (antialiasedRows == SCREEN_HEIGHT) {
+                reportSupersampling(antialiasStats, antialiasStart, SCREEN_WIDTH * SCREEN_HEIGHT);
+            }
+            SDL_Delay(1);
+        } else if (accumulate && still && !accumulator.converged()) {
+            if (accumulator.samplesPerPixel() == 0) {
+                accumulateStart = SDL_GetPerformanceCounter();
+                accumulated = 0;
+            }
+            accumulated += accumulator.accumulate(view, maxIter, palette, colorMode, ACCUMULATE_ROWS,
+                                                  framebuffer.data(), SCREEN_WIDTH).iterations;
+            framebuffer.present();
+            if (accumulator.converged()) {
+                reportAccumulation(accumulator.samplesPerPixel(), accumulated, accumulateStart);
+            }
+            SDL_Delay(1);
+        } else if (idle) {
+            SDL_WaitEventTimeout(nullptr, cycling ? CYCLE_FRAME_MS : IDLE_WAIT_MS);
+        } else {
+            SDL_Delay(1);
+        }
+    }
+
+    if (reference) {
+        reference->cancel();
+    }
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
     SDL_Quit();